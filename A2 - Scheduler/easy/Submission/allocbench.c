@@ -0,0 +1,69 @@
+// Page allocator benchmark: 1 to 8 workers at a time each fork
+// and grow/shrink their memory in a loop, which is almost all
+// kalloc() and kfree().  Compare the ticks taken with the
+// number of cpus, e.g. "make qemu CPUS=4", and combine with
+// "lockstat allocbench" to see the kmem and kcache contention.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXWORKERS 8
+#define NROUNDS    200   // rounds of work per worker
+#define NPAGES     32    // pages grown and shrunk per round
+
+void
+work(void)
+{
+  int i, j, pid;
+  char *p;
+
+  for(i = 0; i < NROUNDS; i++){
+    p = sbrk(NPAGES * 4096);
+    if(p == (char*)-1){
+      printf(1, "allocbench: sbrk failed\n");
+      exit();
+    }
+    for(j = 0; j < NPAGES; j++)
+      p[j * 4096] = j;
+    sbrk(-NPAGES * 4096);
+
+    pid = fork();
+    if(pid < 0){
+      printf(1, "allocbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, max, start, pid;
+
+  max = MAXWORKERS;
+  if(argc > 1)
+    max = atoi(argv[1]);
+  printf(1, "workers ticks (%d rounds each)\n", NROUNDS);
+  for(n = 1; n <= max; n++){
+    start = uptime();
+    for(i = 0; i < n; i++){
+      pid = fork();
+      if(pid < 0){
+        printf(1, "allocbench: fork failed\n");
+        exit();
+      }
+      if(pid == 0){
+        work();
+        exit();
+      }
+    }
+    for(i = 0; i < n; i++)
+      wait();
+    printf(1, "%d %d\n", n, uptime() - start);
+  }
+  exit();
+}
@@ -0,0 +1,36 @@
+// Print free physical memory by block size, and how much of
+// it is fragmented, i.e. not in blocks of the largest order.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "buddyinfo.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct buddyinfo bi;
+  uint total, pages;
+  int k, largest;
+
+  if(buddyinfo(&bi) < 0){
+    printf(2, "buddyinfo failed\n");
+    exit();
+  }
+
+  printf(1, "order pages blocks\n");
+  total = bi.ncached;
+  largest = -1;
+  for(k = 0; k <= KMAXORDER; k++){
+    printf(1, "%d %d %d\n", k, 1 << k, bi.nfree[k]);
+    total += bi.nfree[k] << k;
+    if(bi.nfree[k])
+      largest = k;
+  }
+  pages = bi.nfree[KMAXORDER] << KMAXORDER;
+  printf(1, "free pages: %d, %d in cpu caches\n", total, bi.ncached);
+  printf(1, "largest free block: order %d\n", largest);
+  if(total)
+    printf(1, "fragmented: %d%%\n", (total - pages) * 100 / total);
+  exit();
+}
@@ -0,0 +1,10 @@
+// Free memory by block size, as returned by the
+// buddyinfo() system call.
+// Both the kernel and user programs use this header file.
+
+#define KMAXORDER 10  // largest block is 2^KMAXORDER pages (4MB)
+
+struct buddyinfo {
+  uint nfree[KMAXORDER+1];  // free blocks of 2^k pages
+  uint ncached;             // free pages in the cpu caches and zeroed pool
+};
@@ -0,0 +1,115 @@
+// Test copy-on-write fork: writes after fork stay private to
+// the writer, also when the kernel does the writing, and a
+// large parent forks quickly without copying its memory.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define BIG    (4*1024*1024)   // size of the large parent's heap
+#define NFORK  100             // fork+exec rounds to time
+
+// Parent and child each write a shared page after fork;
+// each must see only its own write.
+void
+privatetest(void)
+{
+  char *p;
+  int pid, fds[2];
+
+  printf(1, "private writes test\n");
+  p = sbrk(4096);
+  p[0] = 'a';
+  if(pipe(fds) != 0)
+    fail("pipe failed");
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    if(p[0] != 'a')
+      fail("child does not see parent's data");
+    // Let the kernel write into the shared page, through read().
+    if(read(fds[0], p+1, 1) != 1 || p[1] != 'k')
+      fail("read into a shared page failed");
+    p[0] = 'c';
+    if(p[0] != 'c' || p[1] != 'k')
+      fail("child lost its own writes");
+    exit();
+  }
+  p[0] = 'b';
+  if(write(fds[1], "k", 1) != 1)
+    fail("write failed");
+  wait();
+  if(p[0] != 'b' || p[1] == 'k')
+    fail("child's writes are visible to the parent");
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-4096);
+  printf(1, "private writes test OK\n");
+}
+
+// Fork a large parent: the child should cost a page table
+// and a kernel stack, not a copy of the heap, and fork+exec
+// should not depend on the heap's size.
+void
+bigtest(void)
+{
+  char *p, *argv[] = { "echo", 0 };
+  int i, pid, before, during, start;
+  int fds[2];
+  char c;
+
+  printf(1, "large parent test\n");
+  p = sbrk(BIG);
+  if(p == (char*)-1)
+    fail("sbrk failed");
+  for(i = 0; i < BIG; i += 4096)
+    p[i] = i;
+
+  if(pipe(fds) != 0)
+    fail("pipe failed");
+  before = freepages();
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    exit();
+  }
+  during = freepages();
+  close(fds[0]);
+  close(fds[1]);
+  wait();
+  printf(1, "  fork of a %d KB parent used %d pages\n",
+         BIG / 1024, before - during);
+  if(before - during > 64)
+    fail("fork copied the parent's memory");
+
+  // Children that only exec, as sh does.
+  start = uptime();
+  for(i = 0; i < NFORK; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork failed");
+    if(pid == 0){
+      close(1);
+      exec("echo", argv);
+      exit();
+    }
+    wait();
+  }
+  printf(1, "  %d fork+exec of a %d KB parent: %d ticks\n",
+         NFORK, BIG / 1024, uptime() - start);
+
+  sbrk(-BIG);
+  printf(1, "large parent test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  privatetest();
+  bigtest();
+  exit();
+}
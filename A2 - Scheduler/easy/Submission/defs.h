@@ -2,13 +2,22 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
+struct lockstat;
+struct buddyinfo;
+struct meminfo;
 struct pipe;
 struct proc;
+struct procmem;
 struct rtcdate;
+struct rwlock;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct swapinfo;
+struct vma;
+struct vmspace;
 struct proc;
 
 // bio.c
@@ -25,6 +34,7 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+int             execload(char*, char**, char*, struct vmspace**, uint*, uint*);
 
 // file.c
 struct file*    filealloc(void);
@@ -54,6 +64,11 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, int);
+int             futexwake(uint, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -66,9 +81,17 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
+char*           kallocn(int);
+void            kbuddyinfo(struct buddyinfo*);
 void            kfree(char*);
+void            kfreen(char*, int);
+void            kincref(char*);
+int             krefcount(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kzerofill(void);
+void            kmeminfo(struct meminfo*);
 
 // kbd.c
 void            kbdintr(void);
@@ -96,8 +119,14 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pagecache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint, uint, int);
+void            pcinval(struct inode*);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
+void            pipeinit(void);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
@@ -121,13 +150,38 @@ void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
+void            inherit(struct sleeplock*);
+void            disinherit(struct sleeplock*);
 int		sched_policy(int, int);
 int		exec_time(int, int);
 int		deadline(int, int);
 int		rate(int,int);
+int		tickets(int, int);
+uint		stridepass(struct proc*);
+uint		lotteryrand(void);
 int             rateToWeight(int);
 int 		isSchedEDF(struct proc*);
 int 		isSchedRM(struct proc*);
+struct proc*    swaphold(void);
+void            swapdone(struct proc*);
+int             procmem(struct procmem*, int);
+int             clone(uint, uint, uint, uint);
+int             spawn(char*, char**, struct file**);
+int             join(uint*);
+int             vmleave(struct vmspace*);
+void            vmstop(struct vmspace*);
+void            vmresume(struct vmspace*);
+void            vmput(struct vmspace*);
+
+// swap.c
+void            swapinit(void);
+int             swapalloc(void);
+void            swapdup(uint);
+void            swapfree(uint);
+void            swapwrite(uint, char*);
+void            swapread(uint, char*);
+char*           ualloc(int);
+void            kswapinfo(struct swapinfo*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -140,6 +194,31 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
+int             lockstat(struct lockstat*, int);
+struct lockcount* lockcountfor(char*);
+
+// shm.c
+void            shminit(void);
+int             shmget(struct proc*, char*, uint);
+int             shmat(struct proc*, int);
+int             shmdt(struct proc*, uint);
+void            shmdup(int);
+void            shmput(int);
+
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint, void(*)(void*));
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            kmallocinit(void);
+void*           kmalloc(uint);
+void            kmfree(void*);
+
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            acquireread(struct rwlock*);
+void            releaseread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            releasewrite(struct rwlock*);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -150,6 +229,7 @@ void            initsleeplock(struct sleeplock*, char*);
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
+void            membench(void);
 void*           memset(void*, int, uint);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
@@ -159,9 +239,10 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
-int             argstr(int, char**);
+int             argoutptr(int, char**, int);
+int             argstr(int, char*, int);
 int             fetchint(uint, int*);
-int             fetchstr(uint, char**);
+int             fetchstr(uint, char*, int);
 void            syscall(void);
 
 // timer.c
@@ -179,6 +260,7 @@ void            uartintr(void);
 void            uartputc(int);
 
 // vm.c
+extern pde_t*   kpgdir;
 void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
@@ -186,13 +268,33 @@ char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
+struct vmspace* vmspacealloc(pde_t*);
+void            vmspacefree(struct vmspace*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*, uint, struct vma*);
+int             mappages(pde_t*, void*, uint, uint, int);
+int             vmfault(struct proc*, uint, int);
+int             vmprefault(struct proc*, uint, uint, int);
+int             vmshared(struct proc*, uint);
+int             pageout(struct proc*, int);
+void            vmcount(pde_t*, struct procmem*);
+void            vmadup(struct vma*, struct vma*);
+void            vmaclose(struct vmspace*);
+void            vmaflush(pde_t*, struct vma*);
+uint            mmapbase(struct proc*);
+int             mmap(struct proc*, uint, int, int, struct inode*, uint, uint);
+int             munmap(struct proc*, uint, uint);
+int             msync(struct proc*, uint, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             copyin(pde_t*, void*, uint, uint);
+int             copyinstr(pde_t*, char*, uint, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+char*           kstackalloc(int);
+void            kstackfree(char*);
+int             kstackguard(uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
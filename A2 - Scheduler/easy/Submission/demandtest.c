@@ -0,0 +1,82 @@
+// Test demand-paged exec(): a program's pages are read from
+// its file only when touched, and then hold the right data.
+// Forks and execs itself as "demandtest child <free pages
+// before the fork>".
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NDATA (40*1024)
+
+// Initialized data, mostly never touched.  The marked bytes
+// sit on both sides of page boundaries.
+char data[NDATA] = {
+  [0] = 1, [4095] = 2, [4096] = 3, [20000] = 4, [NDATA-1] = 5,
+};
+char bss[NDATA];
+
+void
+child(int before)
+{
+  int used, i;
+
+  // The kernel stack, page tables and the pages touched so
+  // far; eager loading would add all of data and bss.
+  used = before - freepages();
+  printf(1, "  exec of a %d KB program used %d pages\n",
+         (int)sizeof(data) / 1024, used);
+  if(used >= NDATA / 4096){
+    printf(1, "demand paging test failed: exec read the whole program\n");
+    exit();
+  }
+  if(data[0] != 1 || data[4095] != 2 || data[4096] != 3 ||
+     data[20000] != 4 || data[NDATA-1] != 5 || data[10000] != 0){
+    printf(1, "demand paging test failed: wrong data\n");
+    exit();
+  }
+  for(i = 0; i < NDATA; i++){
+    if(bss[i] != 0){
+      printf(1, "demand paging test failed: bss not zero\n");
+      exit();
+    }
+  }
+  printf(1, "demand paging test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char buf[16], *args[4];
+  int n, i, pid;
+
+  if(argc > 2 && strcmp(argv[1], "child") == 0){
+    child(atoi(argv[2]));
+    exit();
+  }
+
+  printf(1, "demand paging test\n");
+  n = freepages();
+  i = sizeof(buf) - 1;
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+  args[0] = "demandtest";
+  args[1] = "child";
+  args[2] = buf + i;
+  args[3] = 0;
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec("demandtest", args);
+    printf(1, "demand paging test failed: exec failed\n");
+    exit();
+  }
+  wait();
+  exit();
+}
@@ -3,12 +3,22 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
 
+// Load the program at path into a new address space, with
+// the arguments argv on its stack, for exec() or spawn().
+// Sets *vmp, and *eip and *esp for the first return to user
+// space, and copies the program's name, for debugging, into
+// name, which holds sizeof(struct proc).name bytes.
+// Returns 0, or -1 on error.
 int
-exec(char *path, char **argv)
+execload(char *path, char **argv, char *name, struct vmspace **vmp,
+         uint *eip, uint *esp)
 {
   char *s, *last;
   int i, off;
@@ -16,8 +26,9 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  pde_t *pgdir;
+  struct vmspace *vm;
+  struct vma *v;
 
   begin_op();
 
@@ -28,6 +39,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  vm = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -37,9 +49,13 @@ exec(char *path, char **argv)
 
   if((pgdir = setupkvm()) == 0)
     goto bad;
+  if((vm = vmspacealloc(pgdir)) == 0)
+    goto bad;
 
-  // Load program into memory.
+  // Map the program into memory.  Nothing is read yet:
+  // vmfault() reads each page from the file on first touch.
   sz = 0;
+  v = vm->vma;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -49,12 +65,21 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= KERNBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(v == &vm->vma[NVMA])
       goto bad;
+    v->type = VMA_PROG;
+    v->start = ph.vaddr;
+    v->end = ph.vaddr + ph.memsz;
+    v->ip = idup(ip);
+    v->off = ph.off;
+    v->filesz = ph.filesz;
+    if(v->end > sz)
+      sz = v->end;
+    v++;
   }
   iunlockput(ip);
   end_op();
@@ -91,25 +116,54 @@ exec(char *path, char **argv)
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
-
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
-  curproc->tf->esp = sp;
-  switchuvm(curproc);
-  freevm(oldpgdir);
-  curproc->policy = -1; //Set to default, may need to change?
+  safestrcpy(name, last, sizeof(((struct proc*)0)->name));
+
+  vm->sz = sz;
+  *vmp = vm;
+  *eip = elf.entry;  // main
+  *esp = sp;
   return 0;
 
  bad:
-  if(pgdir)
-    freevm(pgdir);
   if(ip){
     iunlockput(ip);
     end_op();
   }
+  if(vm){
+    begin_op();
+    vmaclose(vm);
+    end_op();
+    vmspacefree(vm);
+  } else if(pgdir)
+    freevm(pgdir);
   return -1;
 }
+
+int
+exec(char *path, char **argv)
+{
+  struct vmspace *vm, *oldvm;
+  uint eip, esp;
+  struct proc *curproc = myproc();
+
+  if(execload(path, argv, curproc->name, &vm, &eip, &esp) < 0)
+    return -1;
+
+  // Commit to the user image.  Threads sharing the old
+  // address space keep it.
+  oldvm = curproc->vm;
+  curproc->vm = vm;
+  curproc->pgdir = vm->pgdir;
+  curproc->tf->eip = eip;
+  curproc->tf->esp = esp;
+  switchuvm(curproc);
+  if(vmleave(oldvm)){
+    vmaflush(oldvm->pgdir, oldvm->vma);
+    begin_op();
+    vmaclose(oldvm);
+    end_op();
+  }
+  vmput(oldvm);
+  curproc->policy = -1; //Set to default, may need to change?
+  return 0;
+}
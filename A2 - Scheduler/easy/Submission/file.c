@@ -5,6 +5,8 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "proc.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
@@ -92,31 +94,61 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
-// Read from file f.
+// Read from file f into addr, a user address of the current
+// process.  Inodes are read a page at a time into kernel memory
+// and copied out after iunlock(): copyout() may fault in a page
+// of this same file, or take vm->lock, and neither is allowed
+// while the inode is locked.
 int
 fileread(struct file *f, char *addr, int n)
 {
-  int r;
+  char *buf;
+  int r, m, tot;
 
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
-    return r;
+    if((buf = kalloc()) == 0)
+      return -1;
+    r = 0;
+    for(tot = 0; tot < n; tot += r){
+      m = n - tot;
+      if(m > PGSIZE)
+        m = PGSIZE;
+      ilock(f->ip);
+      if((r = readi(f->ip, buf, f->off, m)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+      if(r <= 0)
+        break;
+      if(copyout(myproc()->pgdir, (uint)addr + tot, buf, r) < 0){
+        r = -1;
+        break;
+      }
+      // End of file, or a device with no more for now.
+      if(r < m){
+        tot += r;
+        break;
+      }
+    }
+    kfree(buf);
+    if(r < 0 && tot == 0)
+      return -1;
+    return tot;
   }
   panic("fileread");
 }
 
 //PAGEBREAK!
-// Write to file f.
+// Write to file f from addr, a user address of the current
+// process.  As for fileread(), the data is copied in before
+// the inode is locked.
 int
 filewrite(struct file *f, char *addr, int n)
 {
+  char *buf;
   int r;
 
   if(f->writable == 0)
@@ -132,24 +164,29 @@ filewrite(struct file *f, char *addr, int n)
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
     int i = 0;
+    if((buf = kalloc()) == 0)
+      return -1;
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
 
+      if(copyin(myproc()->pgdir, buf, (uint)addr + i, n1) < 0)
+        break;
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
+      // Programs started from now on must see the new contents.
+      pcinval(f->ip);
+      if ((r = writei(f->ip, buf, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
       end_op();
 
-      if(r < 0)
-        break;
       if(r != n1)
-        panic("short filewrite");
+        break;
       i += r;
     }
+    kfree(buf);
     return i == n ? n : -1;
   }
   panic("filewrite");
@@ -0,0 +1,154 @@
+// Futexes: sleeping and waking on a word of user memory, so
+// that user-space locks need not spin.
+//
+// futexwait() sleeps only if the word still holds the value the
+// caller last saw, checked under the queue lock that
+// futexwake() takes, so a wakeup between the caller's check
+// and its sleep is not lost.  Waiters are queued in order
+// on one of NFUTEXQ lists, hashed on a key for the word.  A
+// word in private memory is keyed on its address space and
+// virtual address, which stay the same when fork() makes the
+// page copy-on-write and a write moves it.  A word in a shm
+// segment or MAP_SHARED mapping is keyed on its physical
+// address, so that processes sharing the page find the same
+// queue wherever they map it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NFUTEXQ 64
+
+struct futexkey {
+  struct vmspace *vm;        // Address space, or 0 if shared
+  uint addr;                 // Virtual address, or physical if shared
+};
+
+// A waiting process; lives on its kernel stack.
+struct futexw {
+  struct futexkey key;
+  int woken;                 // Set by futexwake()
+  struct futexw *next;
+};
+
+struct futexq {
+  struct spinlock lock;
+  struct futexw *head;
+};
+
+static struct futexq futexq[NFUTEXQ];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXQ; i++)
+    initlock(&futexq[i].lock, "futex");
+}
+
+static struct futexq*
+hash(struct futexkey *k)
+{
+  return &futexq[(((uint)k->vm >> 4) ^ (k->addr >> 2)) % NFUTEXQ];
+}
+
+// Find the key of the word at addr in p, making its page
+// present first.  Returns -1 if addr is bad.
+static int
+futexkey(struct proc *p, uint addr, struct futexkey *k)
+{
+  char *ka;
+
+  if(addr % 4 != 0 || addr >= KERNBASE)
+    return -1;
+  if(vmprefault(p, addr, 4, 0) < 0)
+    return -1;
+  if(!vmshared(p, addr)){
+    k->vm = p->vm;
+    k->addr = addr;
+    return 0;
+  }
+  if((ka = uva2ka(p->pgdir, (char*)PGROUNDDOWN(addr))) == 0)
+    return -1;
+  k->vm = 0;
+  k->addr = V2P(ka) + addr % PGSIZE;
+  return 0;
+}
+
+// Sleep until futexwake() on addr, if the word at addr is
+// still val.  Returns 0 once woken, or -1 if the word had
+// changed, addr is bad, or the process was killed.
+int
+futexwait(uint addr, int val)
+{
+  struct proc *p = myproc();
+  struct futexq *q;
+  struct futexw w, **pp;
+  char *ka;
+
+  for(;;){
+    if(futexkey(p, addr, &w.key) < 0)
+      return -1;
+    q = hash(&w.key);
+    acquire(&q->lock);
+    // Until we sleep, no other thread can unmap the page or
+    // move it (see vmstop()); but it may have gone while we
+    // were preempted since futexkey().  Fault it in again.
+    if((ka = uva2ka(p->pgdir, (char*)PGROUNDDOWN(addr))) != 0)
+      break;
+    release(&q->lock);
+  }
+  if(*(volatile int*)(ka + addr % PGSIZE) != val){
+    release(&q->lock);
+    return -1;
+  }
+  w.woken = 0;
+  w.next = 0;
+  for(pp = &q->head; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+  while(!w.woken && !p->killed)
+    sleep(&w, &q->lock);
+  if(!w.woken){
+    for(pp = &q->head; *pp != &w; pp = &(*pp)->next)
+      ;
+    *pp = w.next;
+  }
+  release(&q->lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n processes waiting on addr, oldest first.
+// Returns the number woken.
+int
+futexwake(uint addr, int n)
+{
+  struct futexq *q;
+  struct futexw *w, **pp;
+  struct futexkey k;
+  int nwoken;
+
+  if(futexkey(myproc(), addr, &k) < 0)
+    return -1;
+  q = hash(&k);
+  nwoken = 0;
+  acquire(&q->lock);
+  for(pp = &q->head; *pp && nwoken < n; ){
+    w = *pp;
+    if(w->key.vm != k.vm || w->key.addr != k.addr){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    nwoken++;
+  }
+  release(&q->lock);
+  return nwoken;
+}
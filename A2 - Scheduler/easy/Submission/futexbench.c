@@ -0,0 +1,142 @@
+// Compare a spinning lock (lock_t) with a futex mutex
+// (mutex_t) under contention: 1 up to twice as many threads
+// as cpus each take the lock NITER times around a short
+// critical section.  Once threads outnumber cpus, a spinner
+// can burn its whole time slice waiting for a holder that is
+// not running, while a mutex waiter sleeps.  Also checks the
+// condition variable with a ping-pong between two threads.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "meminfo.h"
+
+#define NITER   5000
+#define MAXTHR  8
+#define NPING   1000
+
+lock_t spin;
+mutex_t mutex;
+barrier_t start;
+volatile int counter;
+int usemutex;
+
+cond_t cv;
+volatile int turn;
+
+void
+worker(void *a, void *b)
+{
+  int i, j;
+  volatile int x;
+
+  barrier_wait(&start);
+  for(i = 0; i < NITER; i++){
+    if(usemutex)
+      mutex_lock(&mutex);
+    else
+      lock_acquire(&spin);
+    for(j = 0; j < 20; j++)
+      x = j;
+    counter++;
+    if(usemutex)
+      mutex_unlock(&mutex);
+    else
+      lock_release(&spin);
+    for(j = 0; j < 100; j++)
+      x = j;
+  }
+  (void)x;
+  exit();
+}
+
+// Run n workers with the lock chosen by usemutex.
+// Returns the ticks they took.
+int
+run(int n)
+{
+  int i, t;
+
+  counter = 0;
+  lock_init(&spin);
+  mutex_init(&mutex);
+  barrier_init(&start, n + 1);
+  for(i = 0; i < n; i++)
+    if(thread_create(worker, 0, 0) < 0)
+      fail("thread_create failed");
+  barrier_wait(&start);
+  t = uptime();
+  for(i = 0; i < n; i++)
+    if(thread_join() < 0)
+      fail("thread_join failed");
+  t = uptime() - t;
+  if(counter != n * NITER)
+    fail("lost an update");
+  return t;
+}
+
+// Take turns with main(): wait for turn to be 1, set it to 0.
+void
+ponger(void *a, void *b)
+{
+  int i;
+
+  for(i = 0; i < NPING; i++){
+    mutex_lock(&mutex);
+    while(turn != 1)
+      cond_wait(&cv, &mutex);
+    turn = 0;
+    cond_signal(&cv);
+    mutex_unlock(&mutex);
+  }
+  exit();
+}
+
+void
+pingpong(void)
+{
+  int i, t;
+
+  mutex_init(&mutex);
+  cond_init(&cv);
+  turn = 0;
+  t = uptime();
+  if(thread_create(ponger, 0, 0) < 0)
+    fail("thread_create failed");
+  for(i = 0; i < NPING; i++){
+    mutex_lock(&mutex);
+    while(turn != 0)
+      cond_wait(&cv, &mutex);
+    turn = 1;
+    cond_signal(&cv);
+    mutex_unlock(&mutex);
+  }
+  if(thread_join() < 0)
+    fail("thread_join failed");
+  printf(1, "%d condvar round trips in %d ticks\n", NPING, uptime() - t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+  int n, max, tspin, tmutex;
+
+  if(meminfo(&mi, 0, 0) < 0)
+    fail("meminfo failed");
+  max = 2 * mi.ncpu;
+  if(max > MAXTHR)
+    max = MAXTHR;
+  printf(1, "%d cpus; %d lock round trips per thread\n", mi.ncpu, NITER);
+  printf(1, "threads spin-ticks futex-ticks\n");
+  for(n = 1; n <= max; n *= 2){
+    usemutex = 0;
+    tspin = run(n);
+    usemutex = 1;
+    tmutex = run(n);
+    printf(1, "%d %d %d\n", n, tspin, tmutex);
+  }
+  pingpong();
+  printf(1, "futexbench OK\n");
+  exit();
+}
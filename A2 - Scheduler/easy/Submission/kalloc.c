@@ -1,13 +1,17 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and blocks of
+// 2^k physically contiguous pages with kallocn().
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "proc.h"
 #include "spinlock.h"
+#include "buddyinfo.h"
+#include "meminfo.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -15,14 +19,242 @@ extern char end[]; // first address after kernel loaded from ELF file
 
 struct run {
   struct run *next;
+  struct run *prev;  // only used on the buddy free lists
 };
 
+// The shared pool is a buddy allocator.  A free block of
+// order k is 2^k pages, aligned to its size; its buddy is the
+// block it was split from, whose page number differs only in
+// bit k.  Freeing a block whose buddy is also free merges the
+// two into one block of order k+1.  free[k] is a circular
+// list of the free blocks of order k.
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run free[KMAXORDER+1];
+  uint nfree[KMAXORDER+1];
+  uint npages;       // pages handed to the allocator at boot
 } kmem;
 
+// For each physical page, 1 + the order of the free block
+// that starts there, or 0 if no free block starts there.
+static uchar freeorder[PHYSTOP/PGSIZE];
+
+// For each page handed out by kalloc(), the number of page
+// tables mapping it plus kernel users; copy-on-write fork
+// shares pages.  kfree() frees a page only when this drops
+// to zero.
+static ushort kref[PHYSTOP/PGSIZE];
+
+#define PGNUM(v) (V2P(v) / PGSIZE)
+
+// Each cpu keeps a small cache of free pages in front of
+// the buddy lists, so that cpus allocating in parallel mostly
+// touch only their own lock.  Pages move between a cache and
+// the pool KBATCH at a time; a cpu whose cache and the pool
+// are both empty steals from the other caches.
+#define KBATCH 16   // pages moved to or from the pool at once
+#define KCACHE 64   // a cache holding more gives KBATCH back
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;            // pages on freelist
+  uint nalloc;      // pages allocated on this cpu, for meminfo()
+  uint nfreed;      // pages freed on this cpu
+} __attribute__((aligned(64)));
+
+struct kcache kcache[NCPU];
+
+// Idle cpus keep a pool of pages that are already zero (see
+// kzerofill()), so that kalloc_zeroed() seldom has to clear a
+// page while its caller waits.  Pooled pages count as free:
+// kalloc() falls back on them when nothing else is left.
+#define KZERO 64    // most pages the pool holds
+
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
+static void
+listpush(struct run *head, struct run *r)
+{
+  r->next = head->next;
+  r->prev = head;
+  head->next->prev = r;
+  head->next = r;
+}
+
+static void
+listremove(struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+}
+
+// Return the order k block at v to the pool, merging it
+// with its buddy for as long as the buddy is free too.
+// Caller holds kmem.lock.
+static void
+buddyfree(char *v, int k)
+{
+  uint bn;
+  char *b;
+
+  for(; k < KMAXORDER; k++){
+    bn = PGNUM(v) ^ (1 << k);
+    if(freeorder[bn] != k+1)
+      break;
+    b = (char*)P2V(bn * PGSIZE);
+    listremove((struct run*)b);
+    kmem.nfree[k]--;
+    freeorder[bn] = 0;
+    if(b < v)
+      v = b;
+  }
+  freeorder[PGNUM(v)] = k+1;
+  listpush(&kmem.free[k], (struct run*)v);
+  kmem.nfree[k]++;
+}
+
+// Take an order k block from the pool, splitting the
+// smallest larger block if none is free.
+// Caller holds kmem.lock.
+static char*
+buddyalloc(int k)
+{
+  struct run *r;
+  char *v, *b;
+  int j;
+
+  for(j = k; j <= KMAXORDER; j++)
+    if(kmem.free[j].next != &kmem.free[j])
+      break;
+  if(j > KMAXORDER)
+    return 0;
+  r = kmem.free[j].next;
+  listremove(r);
+  kmem.nfree[j]--;
+  v = (char*)r;
+  freeorder[PGNUM(v)] = 0;
+  // Hand the upper halves back until the block is the right size.
+  while(j > k){
+    j--;
+    b = v + (PGSIZE << j);
+    freeorder[PGNUM(b)] = j+1;
+    listpush(&kmem.free[j], (struct run*)b);
+    kmem.nfree[j]++;
+  }
+  return v;
+}
+
+// Take up to max pages from the pool, returning them
+// as a chain and setting *np to their number.
+static struct run*
+poolget(int max, int *np)
+{
+  struct run *r, *chain;
+  int n;
+
+  chain = 0;
+  acquire(&kmem.lock);
+  for(n = 0; n < max && (r = (struct run*)buddyalloc(0)) != 0; n++){
+    r->next = chain;
+    chain = r;
+  }
+  release(&kmem.lock);
+  *np = n;
+  return chain;
+}
+
+// Give every page of chain back to the pool.
+static void
+poolput(struct run *chain)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(chain){
+    r = chain;
+    chain = r->next;
+    buddyfree((char*)r, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Unlink up to max pages from *list and return them as a
+// chain, setting *np to their number.
+static struct run*
+grab(struct run **list, int max, int *np)
+{
+  struct run *r, *chain;
+  int n;
+
+  chain = 0;
+  for(n = 0; n < max && *list; n++){
+    r = *list;
+    *list = r->next;
+    r->next = chain;
+    chain = r;
+  }
+  *np = n;
+  return chain;
+}
+
+// Push every page of chain onto *list.
+static void
+putback(struct run **list, struct run *chain)
+{
+  struct run *r;
+
+  while(chain){
+    r = chain;
+    chain = r->next;
+    r->next = *list;
+    *list = r;
+  }
+}
+
+// Take a page from the zeroed pool, or return 0.  The
+// page is all zero, and its kref is already 1.
+static struct run*
+zeropop(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.n--;
+  }
+  release(&kzero.lock);
+  if(r)
+    r->next = 0;
+  return r;
+}
+
+// Empty the zeroed pool and every cpu's cache into the pool,
+// so that their pages can merge with their buddies again.
+static void
+kdrain(void)
+{
+  struct run *chain, *r;
+  int i, n;
+
+  while((r = zeropop()) != 0)
+    kfree((char*)r);
+  for(i = 0; i < NCPU; i++){
+    acquire(&kcache[i].lock);
+    chain = grab(&kcache[i].freelist, kcache[i].n, &n);
+    kcache[i].n -= n;
+    release(&kcache[i].lock);
+    poolput(chain);
+  }
+}
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -31,7 +263,14 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(i = 0; i <= KMAXORDER; i++)
+    kmem.free[i].next = kmem.free[i].prev = &kmem.free[i];
+  for(i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -40,6 +279,8 @@ void
 kinit2(void *vstart, void *vend)
 {
   freerange(vstart, vend);
+  // Idle cpus poll use_lock; let them see the free lists first.
+  __sync_synchronize();
   kmem.use_lock = 1;
 }
 
@@ -48,8 +289,11 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kref[PGNUM(p)] = 1;
     kfree(p);
+    kmem.npages++;
+  }
 }
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
@@ -59,21 +303,114 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct kcache *kc;
+  struct run *r, *chain;
+  int n;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  // Still mapped copy-on-write elsewhere?
+  n = __sync_sub_and_fetch(&kref[PGNUM(v)], 1);
+  if(n == (ushort)-1)
+    panic("kfree: not allocated");
+  if(n != 0)
+    return;
+
+#ifdef KALLOC_DEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
+
+  if(!kmem.use_lock){
+    // Still booting: no cpu caches yet.
+    buddyfree(v, 0);
+    return;
+  }
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  pushcli();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->n++;
+  kc->nfreed++;
+  chain = 0;
+  if(kc->n > KCACHE){
+    chain = grab(&kc->freelist, KBATCH, &n);
+    kc->n -= n;
+  }
+  release(&kc->lock);
+  popcli();
+
+  if(chain)
+    poolput(chain);
+}
+
+// Take a free page from this cpu's cache, the pool or
+// another cpu, in that order, or else from the zeroed pool.
+static char*
+allocpage(void)
+{
+  struct kcache *kc;
+  struct run *r, *chain;
+  int i, n;
+
+  if(!kmem.use_lock){
+    if((r = (struct run*)buddyalloc(0)) != 0)
+      kref[PGNUM(r)] = 1;
+    return (char*)r;
+  }
+
+  // Stay on this cpu, so that kc remains our cache.
+  pushcli();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+
+  if(r == 0){
+    // Refill from the shared pool, or failing that take half
+    // of another cpu's cache.  Only one lock is held at a
+    // time, so two cpus stealing from each other can't deadlock.
+    chain = poolget(KBATCH, &n);
+    for(i = 0; chain == 0 && i < NCPU; i++){
+      if(&kcache[i] == kc)
+        continue;
+      acquire(&kcache[i].lock);
+      chain = grab(&kcache[i].freelist, (kcache[i].n + 1) / 2, &n);
+      kcache[i].n -= n;
+      release(&kcache[i].lock);
+    }
+    if(chain){
+      r = chain;
+      acquire(&kc->lock);
+      putback(&kc->freelist, r->next);
+      kc->n += n - 1;
+      release(&kc->lock);
+    }
+  }
+  popcli();
+  if(r == 0)
+    return (char*)zeropop();
+  kref[PGNUM(r)] = 1;
+  return (char*)r;
+}
+
+// Count a page handed out on this cpu.
+static void
+countalloc(void)
+{
+  if(!kmem.use_lock)
+    return;
+  pushcli();
+  kcache[cpuid()].nalloc++;
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -82,15 +419,146 @@ kfree(char *v)
 char*
 kalloc(void)
 {
-  struct run *r;
+  char *v;
+
+  if((v = allocpage()) != 0)
+    countalloc();
+  return v;
+}
+
+// Allocate a page of zeros, preferably one that an idle cpu
+// has already cleared.  Returns 0 if there is no memory.
+char*
+kalloc_zeroed(void)
+{
+  char *v;
+
+  if((v = (char*)zeropop()) == 0 && (v = allocpage()) != 0)
+    memset(v, 0, PGSIZE);
+  if(v)
+    countalloc();
+  return v;
+}
 
-  if(kmem.use_lock)
+// Clear a free page for the zeroed pool, unless it is full.
+// Called by cpus with nothing to run, holding no locks.
+// The other cpus reach the scheduler before kinit2() has
+// finished, while cpu 0 still uses the buddy lists without
+// locks, so do nothing until the allocator is locked.
+void
+kzerofill(void)
+{
+  char *v;
+
+  if(!kmem.use_lock)
+    return;
+  if(kzero.n >= KZERO || (v = allocpage()) == 0)
+    return;
+  memset(v, 0, PGSIZE);
+  acquire(&kzero.lock);
+  if(kzero.n < KZERO){
+    ((struct run*)v)->next = kzero.freelist;
+    kzero.freelist = (struct run*)v;
+    kzero.n++;
+    v = 0;
+  }
+  release(&kzero.lock);
+  if(v)
+    kfree(v);
+}
+
+// Take another reference to page v, from kalloc().
+void
+kincref(char *v)
+{
+  __sync_fetch_and_add(&kref[PGNUM(v)], 1);
+}
+
+// How many references are there to page v?
+int
+krefcount(char *v)
+{
+  return kref[PGNUM(v)];
+}
+
+// Allocate 2^k physically contiguous pages, aligned
+// to their size.  Returns 0 if there is no such block.
+char*
+kallocn(int k)
+{
+  char *v;
+
+  if(k < 0 || k > KMAXORDER)
+    return 0;
+  if(k == 0)
+    return kalloc();
+  acquire(&kmem.lock);
+  v = buddyalloc(k);
+  release(&kmem.lock);
+  if(v == 0){
+    // The pages may be sitting in the cpu caches.
+    kdrain();
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
+    v = buddyalloc(k);
     release(&kmem.lock);
-  return (char*)r;
+  }
+  return v;
+}
+
+// Free 2^k pages returned by kallocn(k).
+void
+kfreen(char *v, int k)
+{
+  if(k == 0){
+    kfree(v);
+    return;
+  }
+  if(k < 0 || k > KMAXORDER || V2P(v) % (PGSIZE << k) ||
+     v < end || V2P(v) + (PGSIZE << k) > PHYSTOP)
+    panic("kfreen");
+
+#ifdef KALLOC_DEBUG
+  memset(v, 1, PGSIZE << k);
+#endif
+
+  acquire(&kmem.lock);
+  buddyfree(v, k);
+  release(&kmem.lock);
+}
+
+// Report the free blocks of each order and the pages
+// held in the cpu caches and the zeroed pool.
+void
+kbuddyinfo(struct buddyinfo *bi)
+{
+  int i;
+
+  acquire(&kmem.lock);
+  for(i = 0; i <= KMAXORDER; i++)
+    bi->nfree[i] = kmem.nfree[i];
+  release(&kmem.lock);
+  bi->ncached = kzero.n;
+  for(i = 0; i < NCPU; i++)
+    bi->ncached += kcache[i].n;
 }
 
+// Report the number of pages, free and zeroed ones, and each
+// cpu's allocation counts.
+void
+kmeminfo(struct meminfo *mi)
+{
+  struct buddyinfo bi;
+  int i;
+
+  kbuddyinfo(&bi);
+  mi->npages = kmem.npages;
+  mi->nfree = bi.ncached;
+  for(i = 0; i <= KMAXORDER; i++)
+    mi->nfree += bi.nfree[i] << i;
+  mi->nzeroed = kzero.n;
+  mi->ncpu = ncpu;
+  for(i = 0; i < MEMINFO_NCPU; i++){
+    mi->nalloc[i] = i < NCPU ? kcache[i].nalloc : 0;
+    mi->nfreed[i] = i < NCPU ? kcache[i].nfreed : 0;
+  }
+}
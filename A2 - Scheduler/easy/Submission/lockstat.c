@@ -0,0 +1,49 @@
+// Print lock contention counters, one line per lock name.
+// Given a command, run it and print only the counts
+// accumulated while it ran, e.g. "lockstat usertests fourfiles".
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+struct lockstat before[NLOCKSTAT], after[NLOCKSTAT];
+
+int
+main(int argc, char *argv[])
+{
+  int i, nbefore, nafter, pid;
+
+  nbefore = 0;
+  if(argc > 1){
+    nbefore = lockstat(before, NLOCKSTAT);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "lockstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+  nafter = lockstat(after, NLOCKSTAT);
+
+  printf(1, "name acquire contended kcycles spun slept\n");
+  for(i = 0; i < nafter; i++){
+    // The kernel only appends names, so a name keeps its slot.
+    if(i < nbefore){
+      after[i].nacquire -= before[i].nacquire;
+      after[i].ncontend -= before[i].ncontend;
+      after[i].kcycles -= before[i].kcycles;
+      after[i].nspin -= before[i].nspin;
+      after[i].nsleep -= before[i].nsleep;
+    }
+    printf(1, "%s %d %d %d %d %d\n", after[i].name, after[i].nacquire,
+           after[i].ncontend, after[i].kcycles, after[i].nspin,
+           after[i].nsleep);
+  }
+  exit();
+}
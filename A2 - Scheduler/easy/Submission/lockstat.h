@@ -0,0 +1,14 @@
+// Lock contention statistics, one entry per lock name,
+// as returned by the lockstat() system call.
+// Both the kernel and user programs use this header file.
+
+#define NLOCKSTAT 32  // distinct lock names tracked
+
+struct lockstat {
+  char name[16];  // Name shared by the locks counted here
+  uint nacquire;  // Acquisitions
+  uint ncontend;  // Acquisitions that had to wait for a holder
+  uint kcycles;   // Cycles spent waiting, in units of 1024
+  uint nspin;     // Sleep lock waits that spun until the holder let go
+  uint nsleep;    // Sleep lock waits that went to sleep
+};
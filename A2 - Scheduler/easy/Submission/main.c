@@ -8,6 +8,7 @@
 
 static void startothers(void);
 static void mpmain(void)  __attribute__((noreturn));
+static uint memtop(void);
 extern pde_t *kpgdir;
 extern char end[]; // first address after kernel loaded from ELF file
 
@@ -29,14 +30,49 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcinit();        // program page cache
+  shminit();       // shared memory segments
+  swapinit();      // swap space
+  futexinit();     // futex wait queues
   fileinit();      // file table
+  kmallocinit();   // small kernel objects
+  pipeinit();      // pipe objects
   ideinit();       // disk 
   startothers();   // start other processors
-  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  kinit2(P2V(4*1024*1024), P2V(memtop())); // must come after startothers()
+#ifdef MEMBENCH
+  membench();      // time memmove() and memcmp()
+#endif
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
 
+// Top of physical memory as the BIOS recorded it in the
+// CMOS, but no higher than PHYSTOP.  A machine with less
+// memory than PHYSTOP (e.g. "make qemu MEM=32") uses only
+// what it has.
+static uint
+memtop(void)
+{
+  uint n;
+
+  // 64KB blocks above 16MB.
+  outb(0x70, 0x34);
+  n = inb(0x71);
+  outb(0x70, 0x35);
+  n |= inb(0x71) << 8;
+  if(n >= (PHYSTOP - 16*1024*1024) / (64*1024))
+    return PHYSTOP;
+  if(n > 0)
+    return 16*1024*1024 + n*64*1024;
+  // Less than 16MB: KB above 1MB.
+  outb(0x70, 0x30);
+  n = inb(0x71);
+  outb(0x70, 0x31);
+  n |= inb(0x71) << 8;
+  return EXTMEM + n*1024;
+}
+
 // Other CPUs jump here from entryother.S.
 static void
 mpenter(void)
@@ -67,6 +103,7 @@ startothers(void)
   uchar *code;
   struct cpu *c;
   char *stack;
+  int k;
 
   // Write entry code to unused memory at 0x7000.
   // The linker has placed the image of entryother.S in
@@ -81,7 +118,9 @@ startothers(void)
     // Tell entryother.S what stack to use, where to enter, and what
     // pgdir to use. We cannot use kpgdir yet, because the AP processor
     // is running in low  memory, so we use entrypgdir for the APs too.
-    stack = kalloc();
+    for(k = 0; (PGSIZE << k) < KSTACKSIZE; k++)
+      ;
+    stack = kallocn(k);
     *(void**)(code-4) = stack + KSTACKSIZE;
     *(void(**)(void))(code-8) = mpenter;
     *(int**)(code-12) = (void *) V2P(entrypgdir);
@@ -0,0 +1,127 @@
+// malloc() benchmark.  Keeps NSLOT blocks live and replaces a
+// random one NOPS times, with sizes drawn from a mix that is
+// mostly small and sometimes several pages.  Reports
+// operations per 100 ticks and fragmentation: how much the
+// heap grew compared with the most bytes ever live at once.
+// Then repeats with NTHREAD threads sharing the heap.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NSLOT   512
+#define NOPS    100000
+#define NTHREAD 4
+
+struct slot {
+  char *p;
+  uint n;
+};
+
+uint seed = 1;
+
+uint
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// 90% up to 128 bytes, 9% up to 2KB, 1% up to 32KB.
+uint
+randsize(void)
+{
+  uint r;
+
+  r = rand() % 100;
+  if(r < 90)
+    return 1 + rand() % 128;
+  if(r < 99)
+    return 1 + rand() % 2048;
+  return 1 + rand() % (32*1024);
+}
+
+// Replace a random block nops times among slots, checking
+// each block's first and last bytes before freeing it.
+// Returns the peak number of bytes live.
+uint
+churn(struct slot *slots, int nslot, int nops, int tag)
+{
+  struct slot *s;
+  uint live, peak;
+  int i;
+
+  live = peak = 0;
+  for(i = 0; i < nops; i++){
+    s = &slots[rand() % nslot];
+    if(s->p){
+      if(s->p[0] != (char)tag || s->p[s->n-1] != (char)tag)
+        fail("block overwritten");
+      free(s->p);
+      live -= s->n;
+    }
+    s->n = randsize();
+    if((s->p = malloc(s->n)) == 0)
+      fail("out of memory");
+    s->p[0] = s->p[s->n-1] = tag;
+    live += s->n;
+    if(live > peak)
+      peak = live;
+  }
+  for(s = slots; s < &slots[nslot]; s++){
+    free(s->p);
+    s->p = 0;
+  }
+  return peak;
+}
+
+struct slot slots[NSLOT];
+struct slot tslots[NTHREAD][NSLOT/NTHREAD];
+
+void
+worker(void *a, void *b)
+{
+  churn(tslots[(int)a], NSLOT/NTHREAD, NOPS/NTHREAD, (int)a + 1);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *heap0;
+  uint peak, grown;
+  int t, i;
+
+  heap0 = sbrk(0);
+  t = uptime();
+  peak = churn(slots, NSLOT, NOPS, 'x');
+  t = uptime() - t;
+  grown = sbrk(0) - heap0;
+  if(t == 0)
+    t = 1;
+  printf(1, "%d malloc/free pairs in %d ticks: %d per 100 ticks\n",
+         NOPS, t, NOPS * 100 / t);
+  printf(1, "peak live %d bytes, heap grew %d bytes (%d%%)\n",
+         peak, grown, grown * 100 / peak);
+
+  // Freed memory must be found again: a second run should
+  // hardly grow the heap.
+  heap0 = sbrk(0);
+  churn(slots, NSLOT, NOPS, 'y');
+  printf(1, "second run grew the heap %d bytes\n", sbrk(0) - heap0);
+
+  t = uptime();
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(worker, (void*)i, 0) < 0)
+      fail("thread_create failed");
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_join() < 0)
+      fail("thread_join failed");
+  t = uptime() - t;
+  if(t == 0)
+    t = 1;
+  printf(1, "%d threads: %d pairs in %d ticks: %d per 100 ticks\n",
+         NTHREAD, NOPS, t, NOPS * 100 / t);
+  printf(1, "mallocbench OK\n");
+  exit();
+}
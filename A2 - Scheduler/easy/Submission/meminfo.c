@@ -0,0 +1,53 @@
+// Print physical memory use: free pages, each cpu's page
+// allocations, and each process's resident, swapped and
+// page-table pages and page faults.  Given a command, run it
+// and also print how many fewer pages are free afterwards,
+// e.g. "meminfo forktest" to look for leaks.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "meminfo.h"
+
+#define NPROCMEM 64
+
+struct meminfo before, mi;
+struct procmem pm[NPROCMEM];
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, pid;
+
+  if(argc > 1){
+    meminfo(&before, 0, 0);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "meminfo: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "meminfo: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+  if((n = meminfo(&mi, pm, NPROCMEM)) < 0){
+    printf(2, "meminfo failed\n");
+    exit();
+  }
+
+  printf(1, "%d of %d pages free, %d of them zeroed\n",
+         mi.nfree, mi.npages, mi.nzeroed);
+  if(argc > 1)
+    printf(1, "%s used %d pages\n", argv[1], before.nfree - mi.nfree);
+  printf(1, "cpu alloc free\n");
+  for(i = 0; i < mi.ncpu && i < MEMINFO_NCPU; i++)
+    printf(1, "%d %d %d\n", i, mi.nalloc[i], mi.nfreed[i]);
+  printf(1, "pid name size rss swap pgtab faults\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%d %s %d %d %d %d %d\n", pm[i].pid, pm[i].name, pm[i].sz,
+           pm[i].rss, pm[i].nswap, pm[i].npgtab, pm[i].nfault);
+  exit();
+}
@@ -0,0 +1,25 @@
+// Memory use, as returned by the meminfo() system call: one
+// struct meminfo for the machine and one struct procmem for
+// each process.
+// Both the kernel and user programs use this header file.
+
+#define MEMINFO_NCPU 8  // cpus reported; at least NCPU
+
+struct meminfo {
+  uint npages;                // pages the allocator manages
+  uint nfree;                 // free pages, cached and zeroed ones too
+  uint nzeroed;               // free pages already cleared
+  uint ncpu;                  // cpus in the machine
+  uint nalloc[MEMINFO_NCPU];  // pages allocated on each cpu since boot
+  uint nfreed[MEMINFO_NCPU];  // pages freed on each cpu since boot
+};
+
+struct procmem {
+  int pid;
+  char name[16];
+  uint sz;      // bytes of memory below the mmap area
+  uint rss;     // pages mapped, in memory
+  uint nswap;   // pages paged out to swap
+  uint npgtab;  // page-table pages, counting the directory
+  uint nfault;  // page faults taken
+};
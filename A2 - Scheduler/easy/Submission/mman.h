@@ -0,0 +1,9 @@
+// Protection and flags for mmap().
+// Both the kernel and user programs use this header file.
+
+#define PROT_READ   0x1   // pages can be read (required)
+#define PROT_WRITE  0x2   // pages can be written
+
+#define MAP_SHARED  0x1   // writes are seen by sharers and reach the file
+#define MAP_PRIVATE 0x2   // writes are private to the process
+#define MAP_ANON    0x4   // zero-filled memory, not backed by a file
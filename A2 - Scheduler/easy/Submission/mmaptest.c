@@ -0,0 +1,218 @@
+// Test mmap(), munmap() and msync(): anonymous and file
+// mappings, private and shared, across fork(), partial
+// unmapping, and faults on unmapped or read-only pages.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+#define PGSIZE 4096
+#define FSIZE  (2*PGSIZE + 100)   // test file size; last page partial
+
+char *file = "mmaptest.tmp";
+
+// Make the test file, byte i holding 'a' + i % 23.
+void
+makefile(void)
+{
+  char buf[100];
+  int fd, i, j, n;
+
+  unlink(file);
+  if((fd = open(file, O_CREATE|O_RDWR)) < 0)
+    fail("cannot create file");
+  for(i = 0; i < FSIZE; i += n){
+    n = FSIZE - i < sizeof(buf) ? FSIZE - i : sizeof(buf);
+    for(j = 0; j < n; j++)
+      buf[j] = 'a' + (i + j) % 23;
+    if(write(fd, buf, n) != n)
+      fail("write failed");
+  }
+  close(fd);
+}
+
+// Does a child touching addr get killed?
+int
+faults(char *addr, int store)
+{
+  int fds[2], pid;
+  char c;
+
+  if(pipe(fds) != 0)
+    fail("pipe failed");
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    close(fds[0]);
+    if(store)
+      *addr = 1;
+    c = *addr;
+    write(fds[1], &c, 1);
+    exit();
+  }
+  close(fds[1]);
+  pid = read(fds[0], &c, 1);
+  close(fds[0]);
+  wait();
+  return pid == 0;
+}
+
+void
+anontest(void)
+{
+  char *p;
+  int i, pid;
+
+  printf(1, "anonymous mapping test\n");
+  p = mmap(0, 10*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+  if(p == (char*)-1)
+    fail("anonymous mmap failed");
+  for(i = 0; i < 10*PGSIZE; i += PGSIZE){
+    if(p[i] != 0)
+      fail("anonymous page is not zero");
+    p[i] = i / PGSIZE;
+  }
+  // A private mapping is copy-on-write across fork.
+  pid = fork();
+  if(pid == 0){
+    p[0] = 99;
+    exit();
+  }
+  wait();
+  if(p[0] != 0 || p[5*PGSIZE] != 5)
+    fail("private anonymous mapping is wrong after fork");
+  // Punch a hole, then check both sides.
+  if(munmap(p + 3*PGSIZE, 2*PGSIZE) < 0)
+    fail("munmap of a hole failed");
+  if(p[2*PGSIZE] != 2 || p[5*PGSIZE] != 5)
+    fail("munmap of a hole lost data");
+  if(!faults(p + 3*PGSIZE, 0))
+    fail("unmapped page did not fault");
+  if(munmap(p, 10*PGSIZE) < 0)
+    fail("munmap failed");
+  if(!faults(p, 0))
+    fail("unmapped page did not fault");
+
+  // A shared mapping is shared with children.
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
+  if(p == (char*)-1)
+    fail("shared anonymous mmap failed");
+  pid = fork();
+  if(pid == 0){
+    p[10] = 42;
+    exit();
+  }
+  wait();
+  if(p[10] != 42)
+    fail("child's write to a shared mapping is not visible");
+  munmap(p, PGSIZE);
+  printf(1, "anonymous mapping test OK\n");
+}
+
+void
+privatetest(void)
+{
+  char *p, buf[10];
+  int fd, i, fds[2];
+
+  printf(1, "private file mapping test\n");
+  makefile();
+  if((fd = open(file, O_RDONLY)) < 0)
+    fail("cannot open file");
+  p = mmap(0, FSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap failed");
+  for(i = 0; i < FSIZE; i++)
+    if(p[i] != 'a' + i % 23)
+      fail("mapping does not hold the file's data");
+  for(i = FSIZE; i < 3*PGSIZE; i++)
+    if(p[i] != 0)
+      fail("mapping past the end of the file is not zero");
+  p[0] = 'Z';
+  // A mapped buffer can be written out directly.
+  if(pipe(fds) != 0)
+    fail("pipe failed");
+  if(write(fds[1], p, 3) != 3 || read(fds[0], buf, 3) != 3 ||
+     buf[0] != 'Z' || buf[2] != 'c')
+    fail("write from a mapping failed");
+  close(fds[0]);
+  close(fds[1]);
+  munmap(p, FSIZE);
+  if(read(fd, buf, 1) != 1 || buf[0] != 'a')
+    fail("private write reached the file");
+  close(fd);
+
+  // Read-only mappings can't be written.
+  fd = open(file, O_RDONLY);
+  p = mmap(0, PGSIZE, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    fail("read-only mmap failed");
+  if(!faults(p, 1))
+    fail("write to a read-only mapping did not fault");
+  if(read(fd, p, 1) != -1)
+    fail("read() into a read-only mapping succeeded");
+  if(mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (char*)-1)
+    fail("writable shared mapping of a read-only file");
+  munmap(p, PGSIZE);
+  close(fd);
+  printf(1, "private file mapping test OK\n");
+}
+
+void
+sharedtest(void)
+{
+  char *p, *q, buf[4];
+  int fd, pid;
+
+  printf(1, "shared file mapping test\n");
+  makefile();
+  if((fd = open(file, O_RDWR)) < 0)
+    fail("cannot open file");
+  p = mmap(0, FSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, FSIZE, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1)
+    fail("mmap failed");
+
+  // Writes are seen by other mappings, also in children ...
+  p[1] = 'X';
+  if(q[1] != 'X')
+    fail("other mapping does not see a write");
+  pid = fork();
+  if(pid == 0){
+    p[PGSIZE] = 'Y';
+    exit();
+  }
+  wait();
+  if(q[PGSIZE] != 'Y')
+    fail("child's write is not visible");
+
+  // ... and reach the file on msync() and munmap().
+  if(msync(p, PGSIZE) < 0)
+    fail("msync failed");
+  if(read(fd, buf, 2) != 2 || buf[1] != 'X')
+    fail("msync did not write the file");
+  p[2*PGSIZE + 99] = 'W';
+  munmap(p, FSIZE);
+  munmap(q, FSIZE);
+  close(fd);
+  fd = open(file, O_RDONLY);
+  p = mmap(0, FSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p[1] != 'X' || p[PGSIZE] != 'Y' || p[2*PGSIZE + 99] != 'W')
+    fail("munmap did not write the file");
+  munmap(p, FSIZE);
+  close(fd);
+  unlink(file);
+  printf(1, "shared file mapping test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  anontest();
+  privatetest();
+  sharedtest();
+  exit();
+}
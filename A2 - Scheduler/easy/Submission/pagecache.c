@@ -0,0 +1,186 @@
+// Cache of file pages, shared between the processes running
+// the same program or mapping the same file.
+//
+// vmfault() maps a page of a program's file by asking pcget()
+// for it, and maps the cached page copy-on-write: every process
+// running sh shares one copy of each page of sh that has been
+// touched, and a new sh reads none of them from disk.  A write
+// gives the writer a private copy, since the cache holds a
+// reference of its own.  MAP_SHARED mappings map the cached
+// page writable, so that all sharers see each other's writes.
+//
+// Pages are named by device, inode number and file offset, so
+// that they outlive the in-memory inode, and hold as much of the
+// file as reaches into the page.  A program whose data segment
+// ends inside a page wants the rest of it zero; it gets a
+// private copy.  write() and truncation drop a file's pages;
+// processes that have them mapped keep their references.  Only
+// pages no process maps are evicted, and a MAP_SHARED fault
+// fails rather than map a page the cache cannot hold, so that
+// mappers of a file never end up with different copies.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;         // file offset of the page's data
+  uint len;         // bytes from the file; the rest is zero
+  char *page;       // or 0 if the slot is free
+  uint lastuse;     // for evicting the least recently used page
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+  uint clock;
+  int n;            // slots in use
+} pcache;
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+static struct pcpage*
+pclookup(struct inode *ip, uint off)
+{
+  struct pcpage *pp;
+
+  for(pp = pcache.page; pp < &pcache.page[NPCACHE]; pp++)
+    if(pp->page && pp->off == off && pp->inum == ip->inum &&
+       pp->dev == ip->dev)
+      return pp;
+  return 0;
+}
+
+// mem holds len bytes of the file, and the caller, which has
+// a reference to it, wants only n of them.  Unless the caller
+// is sharing the page, give it a copy with the rest cleared.
+static char*
+pctrim(char *mem, uint len, uint n, int shared)
+{
+  char *copy;
+
+  if(shared || n >= len)
+    return mem;
+  if((copy = kalloc_zeroed()) != 0)
+    memmove(copy, mem, n);
+  kfree(mem);
+  return copy;
+}
+
+// Return the page of ip at offset off, with a reference for
+// the caller, of which the caller wants the first n bytes
+// and zeros after them.  If shared is set, as for a MAP_SHARED
+// mapping, the page is the one every sharer maps, and any more
+// of the file that it holds is left in place.  Reads the file,
+// and so may sleep, if the page is not cached.  Returns 0 if
+// the page cannot be read, or cannot be cached for sharing.
+char*
+pcget(struct inode *ip, uint off, uint n, int shared)
+{
+  struct pcpage *pp, *victim;
+  char *mem;
+  uint len;
+
+  acquire(&pcache.lock);
+  if((pp = pclookup(ip, off)) != 0){
+    pp->lastuse = ++pcache.clock;
+    kincref(pp->page);
+    mem = pp->page;
+    len = pp->len;
+    release(&pcache.lock);
+    return pctrim(mem, len, n, shared);
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  ilock(ip);
+  len = ip->size > off ? ip->size - off : 0;
+  if(len > PGSIZE)
+    len = PGSIZE;
+  if(len > 0 && readi(ip, mem, off, len) != len){
+    iunlock(ip);
+    kfree(mem);
+    return 0;
+  }
+
+  // Insert before iunlock(), so that a write to ip either
+  // came before readi() or drops the page in pcinval().
+  acquire(&pcache.lock);
+  if((pp = pclookup(ip, off)) != 0){
+    // Someone else read it in meanwhile.
+    kfree(mem);
+    mem = pp->page;
+    len = pp->len;
+  } else {
+    victim = 0;
+    for(pp = pcache.page; pp < &pcache.page[NPCACHE]; pp++){
+      if(pp->page == 0){
+        victim = pp;
+        break;
+      }
+      if(krefcount(pp->page) == 1 &&
+         (victim == 0 || pp->lastuse < victim->lastuse))
+        victim = pp;
+    }
+    if(victim == 0){
+      // Every cached page is in use.  A private mapping can
+      // have this page uncached, but a sharer must not.
+      release(&pcache.lock);
+      iunlock(ip);
+      if(shared){
+        kfree(mem);
+        return 0;
+      }
+      if(n < len)
+        memset(mem + n, 0, len - n);
+      return mem;
+    }
+    pp = victim;
+    if(pp->page)
+      kfree(pp->page);
+    else
+      pcache.n++;
+    pp->dev = ip->dev;
+    pp->inum = ip->inum;
+    pp->off = off;
+    pp->len = len;
+    pp->page = mem;
+  }
+  pp->lastuse = ++pcache.clock;
+  kincref(mem);
+  release(&pcache.lock);
+  iunlock(ip);
+  return pctrim(mem, len, n, shared);
+}
+
+// Drop the cached pages of ip, whose contents are changing.
+// The caller holds ip's lock.
+void
+pcinval(struct inode *ip)
+{
+  struct pcpage *pp;
+
+  if(pcache.n == 0)
+    return;
+  acquire(&pcache.lock);
+  for(pp = pcache.page; pp < &pcache.page[NPCACHE]; pp++){
+    if(pp->page && pp->inum == ip->inum && pp->dev == ip->dev){
+      kfree(pp->page);
+      pp->page = 0;
+      pcache.n--;
+    }
+  }
+  release(&pcache.lock);
+}
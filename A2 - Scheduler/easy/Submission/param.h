@@ -1,5 +1,8 @@
 #define NPROC        64  // maximum number of processes
-#define KSTACKSIZE 4096  // size of per-process kernel stack
+#ifndef KSTACKPAGES
+#define KSTACKPAGES   2  // pages per kernel stack
+#endif
+#define KSTACKSIZE   (KSTACKPAGES*4096)  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -7,8 +10,15 @@
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NVMA         16  // demand-paged memory regions per process
+#define NPCACHE     128  // program pages cached for sharing
+#define NSHM         16  // shared memory segments
+#define SHMMAXPAGES  64  // pages per shared memory segment
+#define SHMNAME      16  // bytes in a shared memory segment's name
+#define MAXPATH     128  // maximum file path name
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
+#define SWAPSIZE    65536  // blocks of swap space, after the file system
 
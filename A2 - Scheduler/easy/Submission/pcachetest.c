@@ -0,0 +1,122 @@
+// Test the program page cache: instances of a program after
+// the first share its pages, and a program file that is
+// rewritten runs its new contents.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NINST 4   // instances of cat kept running
+
+// Start prog with stdin from fd in and stdout to fd out.
+int
+start(char *prog, char *arg, int in, int out)
+{
+  char *argv[3];
+  int pid;
+
+  argv[0] = prog;
+  argv[1] = arg;
+  argv[2] = 0;
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    close(0);
+    dup(in);
+    close(1);
+    dup(out);
+    exec(prog, argv);
+    fail("exec failed");
+  }
+  return pid;
+}
+
+// Copy file src to dst, writing over dst's old contents.
+void
+copy(char *src, char *dst)
+{
+  char buf[512];
+  int fd0, fd1, n;
+
+  if((fd0 = open(src, O_RDONLY)) < 0)
+    fail("cannot open source");
+  if((fd1 = open(dst, O_CREATE|O_WRONLY)) < 0)
+    fail("cannot create copy");
+  while((n = read(fd0, buf, sizeof(buf))) > 0)
+    if(write(fd1, buf, n) != n)
+      fail("write failed");
+  close(fd0);
+  close(fd1);
+}
+
+// Run prog with arg, feeding it input, and check its output.
+void
+check(char *prog, char *arg, char *input, char *want)
+{
+  int in[2], out[2], n, m;
+  char buf[32];
+
+  if(pipe(in) != 0 || pipe(out) != 0)
+    fail("pipe failed");
+  start(prog, arg, in[0], out[1]);
+  close(in[0]);
+  close(out[1]);
+  write(in[1], input, strlen(input));
+  close(in[1]);
+  n = 0;
+  while(n < sizeof(buf) - 1 && (m = read(out[0], buf + n, sizeof(buf) - 1 - n)) > 0)
+    n += m;
+  close(out[0]);
+  wait();
+  buf[n] = 0;
+  if(strcmp(buf, want) != 0)
+    fail("program ran stale pages");
+}
+
+void
+sharetest(void)
+{
+  int fds[2], i, before, cost[NINST];
+
+  printf(1, "shared pages test\n");
+  if(pipe(fds) != 0)
+    fail("pipe failed");
+  for(i = 0; i < NINST; i++){
+    before = freepages();
+    start("cat", 0, fds[0], 1);
+    sleep(20);    // let it start and block reading
+    cost[i] = before - freepages();
+    printf(1, "  cat instance %d: %d pages\n", i, cost[i]);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < NINST; i++)
+    wait();
+  if(cost[NINST-1] >= cost[0])
+    fail("later instances did not share pages");
+  printf(1, "shared pages test OK\n");
+}
+
+void
+rewritetest(void)
+{
+  printf(1, "rewritten program test\n");
+  copy("echo", "pcache.tmp");
+  check("pcache.tmp", "hello", "", "hello\n");
+  check("pcache.tmp", "hello", "", "hello\n");
+  // Same inode, new contents.
+  copy("cat", "pcache.tmp");
+  check("pcache.tmp", 0, "from cat\n", "from cat\n");
+  unlink("pcache.tmp");
+  printf(1, "rewritten program test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  sharetest();
+  rewritetest();
+  exit();
+}
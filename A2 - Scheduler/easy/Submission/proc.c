@@ -6,24 +6,43 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
-
+#include "sleeplock.h"
+#include "vmspace.h"
+#include "rwlock.h"
+#include "meminfo.h"
+
+// lock protects the process states and everything the
+// scheduler uses.  The scheduling attributes (policy,
+// deadline, exec_time, rate, tickets, arrival_time) are
+// also protected by attrlock: writers hold both, so that
+// admission tests and other read-only scans can take just
+// attrlock for reading and never hold up the scheduler.
+// A stride process's pass changes as it runs, so it is not
+// an attribute: only lock protects it.
 struct {
   struct spinlock lock;
+  struct rwlock attrlock;
   struct proc proc[NPROC];
 } ptable;
 
 static struct proc *initproc;
 
+#define STRIDE1  (1<<20)  // stride of a process holding a single ticket
+#define NTICKETS 100      // tickets of a fresh process
+
 int nextpid = 1;
+static uint lotteryseed = 1;
 extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static int minpass(struct proc*, uint*);
 
 void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
+  initrwlock(&ptable.attrlock, "ptable attrs");
 }
 
 // Must be called with interrupts disabled
@@ -94,10 +113,19 @@ found:
   p->arrival_time = 0;
   p->ticksproc = 0;
   p->deadline = 0;
+  p->tickets = NTICKETS;
+  p->stride = STRIDE1 / NTICKETS;
+  p->pass = 0;
+  p->donor = 0;
+  p->blockedon = 0;
+  p->insyscall = 0;
+  p->nfault = 0;
+  p->ustack = 0;
+  p->vm = 0;
   release(&ptable.lock);
 
   // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
+  if((p->kstack = kstackalloc(p - ptable.proc)) == 0){
     p->state = UNUSED;
     return 0;
   }
@@ -131,10 +159,10 @@ userinit(void)
   p = allocproc();
   //cprintf("allocated init \n");
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->pgdir = setupkvm()) == 0 || (p->vm = vmspacealloc(p->pgdir)) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  p->vm->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -161,27 +189,36 @@ userinit(void)
 }
 
 // Grow current process's memory by n bytes.
-
-
-
-// Return 0 on success, -1 on failure.
+// Return the old size, or -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, oldsz;
   struct proc *curproc = myproc();
+  struct vmspace *vm = curproc->vm;
 
-  sz = curproc->sz;
+  acquiresleep(&vm->lock);
+  sz = oldsz = vm->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Allocate lazily: vmfault() maps each page on first touch.
+    if(sz + n < sz || sz + n > mmapbase(curproc)){
+      releasesleep(&vm->lock);
       return -1;
+    }
+    sz += n;
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    vmstop(vm);
+    sz = deallocuvm(vm->pgdir, sz, sz + n);
+    vmresume(vm);
+    if(sz == 0){
+      releasesleep(&vm->lock);
       return -1;
+    }
   }
-  curproc->sz = sz;
+  vm->sz = sz;
   switchuvm(curproc);
-  return 0;
+  releasesleep(&vm->lock);
+  return oldsz;
 }
 
 // Create a new process copying p as the parent.
@@ -200,13 +237,23 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
+  // Copying marks our pages copy-on-write.
+  acquiresleep(&curproc->vm->lock);
+  vmstop(curproc->vm);
+  np->pgdir = copyuvm(curproc->pgdir, curproc->vm->sz, curproc->vm->vma);
+  vmresume(curproc->vm);
+  if(np->pgdir && (np->vm = vmspacealloc(np->pgdir)) == 0)
+    freevm(np->pgdir);
+  if(np->pgdir == 0 || np->vm == 0){
+    releasesleep(&curproc->vm->lock);
+    kstackfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
-  np->sz = curproc->sz;
+  np->vm->sz = curproc->vm->sz;
+  vmadup(np->vm->vma, curproc->vm->vma);
+  releasesleep(&curproc->vm->lock);
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -220,6 +267,9 @@ fork(void)
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
   np->policy = curproc->policy;
+  np->tickets = curproc->tickets;
+  np->stride = curproc->stride;
+  np->pass = curproc->pass;
   pid = np->pid;
 
   acquire(&ptable.lock);
@@ -230,6 +280,113 @@ fork(void)
   return pid;
 }
 
+// Start the program at path with arguments argv in a new
+// child process, as fork() then exec() would, but without
+// copying the caller's memory.  The child's descriptor i is
+// ofile[i], or, if ofile is 0, the caller's descriptor i.
+// Returns the child's pid, or -1.
+int
+spawn(char *path, char **argv, struct file **ofile)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
+  struct file *f;
+  uint eip, esp;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  if(execload(path, argv, np->name, &np->vm, &eip, &esp) < 0){
+    kstackfree(np->kstack);
+    np->kstack = 0;
+    np->vm = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  np->pgdir = np->vm->pgdir;
+  np->parent = curproc;
+  memset(np->tf, 0, sizeof(*np->tf));
+  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  np->tf->es = np->tf->ds;
+  np->tf->ss = np->tf->ds;
+  np->tf->eflags = FL_IF;
+  np->tf->esp = esp;
+  np->tf->eip = eip;
+
+  for(i = 0; i < NOFILE; i++){
+    f = ofile ? ofile[i] : curproc->ofile[i];
+    if(f)
+      np->ofile[i] = filedup(f);
+  }
+  np->cwd = idup(curproc->cwd);
+
+  np->tickets = curproc->tickets;
+  np->stride = curproc->stride;
+  np->pass = curproc->pass;
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+  np->state = RUNNABLE;
+  release(&ptable.lock);
+  return pid;
+}
+
+// Create a thread: a process sharing the caller's memory,
+// open files and directory, that runs fcn(arg1, arg2) on the
+// page-aligned one-page user stack at stack.  If fcn returns,
+// it returns to a bad address and faults; it should exit().
+// Returns the new thread's pid, or -1.
+int
+clone(uint fcn, uint arg1, uint arg2, uint stack)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
+  uint ustack[3];
+
+  if(stack % PGSIZE != 0 || stack + PGSIZE < stack)
+    return -1;
+
+  // Push a fake return PC and the arguments.
+  ustack[0] = 0xffffffff;
+  ustack[1] = arg1;
+  ustack[2] = arg2;
+  if(vmprefault(curproc, stack + PGSIZE - sizeof(ustack), sizeof(ustack), 1) < 0 ||
+     copyout(curproc->pgdir, stack + PGSIZE - sizeof(ustack), ustack, sizeof(ustack)) < 0)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  np->pgdir = curproc->pgdir;
+  np->vm = curproc->vm;
+  np->parent = curproc;
+  np->ustack = stack;
+  *np->tf = *curproc->tf;
+  np->tf->eip = fcn;
+  np->tf->esp = stack + PGSIZE - sizeof(ustack);
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  np->policy = curproc->policy;
+  np->tickets = curproc->tickets;
+  np->stride = curproc->stride;
+  np->pass = curproc->pass;
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+  np->vm->ref++;
+  np->vm->nlive++;
+  np->state = RUNNABLE;
+  release(&ptable.lock);
+  return pid;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -238,7 +395,7 @@ exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
+  int fd, last;
 
   if(curproc == initproc)
    {cprintf("panicked because exiting process the initproc?");
@@ -252,8 +409,14 @@ exit(void)
     }
   }
 
+  // The last thread out closes the regions.
+  last = vmleave(curproc->vm);
+  if(last)
+    vmaflush(curproc->pgdir, curproc->vm->vma);
   begin_op();
   iput(curproc->cwd);
+  if(last)
+    vmaclose(curproc->vm);
   end_op();
   curproc->cwd = 0;
 
@@ -279,8 +442,90 @@ exit(void)
   panic("zombie exit");
 }
 
+// The calling process is done with vm, by exit() or exec().
+// Returns 1 if no other live process uses it, in which case
+// the caller should close its regions.
+int
+vmleave(struct vmspace *vm)
+{
+  int last;
+
+  acquire(&ptable.lock);
+  last = --vm->nlive == 0;
+  release(&ptable.lock);
+  return last;
+}
+
+// Drop a reference to vm, freeing it with the last one.
+void
+vmput(struct vmspace *vm)
+{
+  int ref;
+
+  acquire(&ptable.lock);
+  ref = --vm->ref;
+  release(&ptable.lock);
+  if(ref == 0)
+    vmspacefree(vm);
+}
+
+// Free the zombie p, and its address space if no other
+// process uses it.  Caller holds ptable.lock.
+static void
+reap(struct proc *p)
+{
+  kstackfree(p->kstack);
+  p->kstack = 0;
+  if(--p->vm->ref == 0)
+    vmspacefree(p->vm);
+  p->vm = 0;
+  p->pgdir = 0;
+}
+
+// Wait for a thread made by clone() to exit and return its
+// pid, storing the stack it was given in *stack.
+// Return -1 if this process has no threads.
+int
+join(uint *stack)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    havekids = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->parent != curproc || p->vm != curproc->vm)
+        continue;
+      havekids = 1;
+      if(p->state == ZOMBIE){
+        pid = p->pid;
+        *stack = p->ustack;
+        reap(p);
+        p->pid = 0;
+        p->parent = 0;
+        p->name[0] = 0;
+        p->killed = 0;
+        p->state = UNUSED;
+        release(&ptable.lock);
+        return pid;
+      }
+    }
+
+    if(!havekids || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    // exit() wakes the parent.
+    sleep(curproc, &ptable.lock);
+  }
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Threads are waited for with join() instead.
 int
 wait(void)
 {
@@ -293,15 +538,13 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      if(p->parent != curproc || p->vm == curproc->vm)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
+        reap(p);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -323,6 +566,36 @@ wait(void)
   }
 }
 
+// The process whose class, deadline and rate p is scheduled
+// with: p itself, or the end of the chain of processes lending
+// p their priority through sleeplocks p holds.
+static struct proc*
+schedattr(struct proc *p)
+{
+  int depth;
+
+  for(depth = 0; p->donor && depth < NPROC; depth++)
+    p = p->donor;
+  return p;
+}
+
+// Should a, waiting on a sleeplock held by b, lend b its priority?
+// Only the real-time classes are lent; within a class the earlier
+// deadline or the smaller RM weight runs first.
+static int
+runsahead(struct proc *a, struct proc *b)
+{
+  if(a->policy != 0 && a->policy != 1)
+    return 0;
+  if(b->policy != 0 && b->policy != 1)
+    return 1;
+  if(a->policy != b->policy)
+    return 0;
+  if(a->policy == 0)
+    return a->deadline < b->deadline;
+  return rateToWeight(a->rate) < rateToWeight(b->rate);
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -339,53 +612,86 @@ scheduler(void)
   c->proc = 0;
   
   struct proc *minP = 0;  //will set it to the appropriate val later, anyways
+  int ran;
 
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
+    ran = 0;
     acquire(&ptable.lock);   
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     	if(p->state != RUNNABLE){continue;}
     	
     	
-    	if(p->policy == -1){
+    	if(schedattr(p)->policy == -1){
     	        //cprintf("check\n"); //execute on the spot
     		minP = p;
     	}
-    	else if(p->policy == 0){//EDF proc exists, traverse list to find min deadline 
+    	else if(schedattr(p)->policy == 0){//EDF proc exists, traverse list to find min deadline 
                 //cprintf("state %d pid %d\n", p->state, p->pid);
                 int minDeadline = 214783647;
                 struct proc *q;
                 for(q = ptable.proc; q<&ptable.proc[NPROC]; q++){
                 	if(q->state != RUNNABLE){continue;}
-                	if(q->policy != 0){continue;}
+                	if(schedattr(q)->policy != 0){continue;}
                 	
                 	//minDeadline initailised to infinity, first condition always true for first EDF proc
-                	if(q->deadline < minDeadline){minDeadline = q->deadline;minP = q;}
-                	else if(q->deadline == minDeadline){if((q->pid) < (minP->pid)){minP = q;}}                
+                	if(schedattr(q)->deadline < minDeadline){minDeadline = schedattr(q)->deadline;minP = q;}
+                	else if(schedattr(q)->deadline == minDeadline){if((q->pid) < (minP->pid)){minP = q;}}                
                 
                 }
         }
-        else if(p->policy == 1){//RM process exists, traverse list to find max weight min pid
+        else if(schedattr(p)->policy == 1){//RM process exists, traverse list to find max weight min pid
                 //cprintf("p with pid %d with policy %d, state %d\n",p->pid, p->policy, p->state);
                 int minWeight = 4;
                 struct proc *q;
                 for(q = ptable.proc; q<&ptable.proc[NPROC]; q++){
                 	if(q->state != RUNNABLE){continue;}
-                	if(q->policy != 1){continue;}
+                	if(schedattr(q)->policy != 1){continue;}
                 	
                 	//cprintf("rm iterates through pid %d with policy %d, state %d\n",q->pid, q->policy, q->state);
                 	//minWeight initailised to 4, first condition always true for first RM proc
-                	if(rateToWeight(q->rate) < minWeight){minP = q; minWeight = rateToWeight(q->rate);}
-      			else if(rateToWeight(q->rate) == minWeight && ((q->pid) < (minP->pid))){minP = q;}
+                	if(rateToWeight(schedattr(q)->rate) < minWeight){minP = q; minWeight = rateToWeight(schedattr(q)->rate);}
+      			else if(rateToWeight(schedattr(q)->rate) == minWeight && ((q->pid) < (minP->pid))){minP = q;}
      			
                 }
                 //cprintf("rm picks minP with pid %d with policy %d, state %d\n",minP->pid, minP->policy, minP->state);
         }
+        else if(schedattr(p)->policy == 2){//stride proc exists, traverse list to find min pass min pid
+                struct proc *q;
+                minP = p;
+                for(q = ptable.proc; q<&ptable.proc[NPROC]; q++){
+                	if(q->state != RUNNABLE){continue;}
+                	if(schedattr(q)->policy != 2){continue;}
+                	
+                	//pass wraps around, compare the signed distance
+                	if((int)(q->pass - minP->pass) < 0){minP = q;}
+                	else if(q->pass == minP->pass && ((q->pid) < (minP->pid))){minP = q;}
+                }
+                minP->pass += minP->stride;
+        }
+        else if(schedattr(p)->policy == 3){//lottery proc exists, draw a ticket among runnable lottery procs
+                struct proc *q;
+                int total = 0;
+                int winner;
+                for(q = ptable.proc; q<&ptable.proc[NPROC]; q++){
+                	if(q->state == RUNNABLE && schedattr(q)->policy == 3){total += q->tickets;}
+                }
+                winner = lotteryrand() % total;
+                minP = p;
+                for(q = ptable.proc; q<&ptable.proc[NPROC]; q++){
+                	if(q->state != RUNNABLE){continue;}
+                	if(schedattr(q)->policy != 3){continue;}
+                	
+                	if(winner < q->tickets){minP = q; break;}
+                	winner -= q->tickets;
+                }
+        }
       	if(minP->state!= ZOMBIE){
       		//cprintf("Process state %d pid %d\n", minP->state, minP->pid);
       	//cprintf("Sched picks process pid %d with policy %d\n",minP->pid, minP->policy);
+      		ran = 1;
       		c->proc = minP;
       		switchuvm(minP);
       		minP->state = RUNNING;
@@ -396,6 +702,9 @@ scheduler(void)
        
    }//inner for loop
    release(&ptable.lock);     
+   // Nothing to run: clear pages for kalloc_zeroed().
+   if(!ran)
+     kzerofill();
   }//infinite for loop
 }//function ki last bracket
 
@@ -422,6 +731,13 @@ sched(void)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  if(p->vm && p->vm->stopper && p->vm->stopper != p){
+    // Another thread is changing our page table: stay off the
+    // cpus until vmresume(), and tell it we have left this one.
+    if(p->state == RUNNABLE)
+      p->state = PAGEOUT;
+    wakeup1(&p->vm->stopper);
+  }
   intena = mycpu()->intena;
   //if(p->policy == -1){
   //cprintf("sched checpoint 1 p state %d, pid %d\n", p->state, p->pid);
@@ -446,6 +762,191 @@ yield(void)
   release(&ptable.lock);
 }
 
+// Can p's pages be paged out?  Only if p and every thread
+// sharing its memory are waiting to return to user space, so
+// that nothing is using that memory.  Caller holds ptable.lock.
+static int
+swappable(struct proc *p)
+{
+  struct proc *q;
+
+  if(p->state != RUNNABLE || p->insyscall || p->killed)
+    return 0;
+  // A fault in progress.
+  if(p->vm->lock.locked)
+    return 0;
+  if(p->vm->nlive == 1)
+    return 1;
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q->vm == p->vm && q->state != ZOMBIE &&
+       (q->state != RUNNABLE || q->insyscall))
+      return 0;
+  return 1;
+}
+
+// Pick a process whose pages can be paged out, and keep it
+// and its threads off the cpus until swapdone().  Each call
+// resumes the search after the process picked last time.
+// Returns 0 if there is none.
+struct proc*
+swaphold(void)
+{
+  static int hand;
+  struct proc *p, *q;
+  int i;
+
+  acquire(&ptable.lock);
+  for(i = 0; i < NPROC; i++){
+    p = &ptable.proc[(hand + i) % NPROC];
+    if(swappable(p)){
+      hand = (hand + i + 1) % NPROC;
+      for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+        if(q->vm == p->vm && q->state == RUNNABLE)
+          q->state = PAGEOUT;
+      release(&ptable.lock);
+      return p;
+    }
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// The current process is about to take away or write-protect
+// pages of vm.  There is no TLB shootdown, so first get the
+// other threads sharing vm off the cpus, where their TLBs may
+// still allow the old access, and keep them off until
+// vmresume(); each switch to a process reloads %cr3, which
+// flushes the user TLB entries.  Caller holds vm->lock.
+void
+vmstop(struct vmspace *vm)
+{
+  struct proc *p = myproc();
+  struct proc *q;
+  int running;
+
+  acquire(&ptable.lock);
+  if(vm->nlive > 1){
+    vm->stopper = p;
+    for(;;){
+      running = 0;
+      for(q = ptable.proc; q < &ptable.proc[NPROC]; q++){
+        if(q == p || q->vm != vm)
+          continue;
+        if(q->state == RUNNABLE)
+          q->state = PAGEOUT;
+        else if(q->state == RUNNING)
+          running = 1;
+      }
+      if(!running)
+        break;
+      // sched() wakes us as each one leaves its cpu.
+      sleep(&vm->stopper, &ptable.lock);
+    }
+  }
+  release(&ptable.lock);
+}
+
+// Let the threads held off by vmstop() run again.
+void
+vmresume(struct vmspace *vm)
+{
+  struct proc *q;
+
+  acquire(&ptable.lock);
+  if(vm->stopper == myproc()){
+    vm->stopper = 0;
+    for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+      if(q->vm == vm && q->state == PAGEOUT)
+        q->state = RUNNABLE;
+  }
+  release(&ptable.lock);
+}
+
+// Describe the memory of up to n processes in pm.
+// Returns the number described.  Walking the page tables is
+// slow, so it happens after ptable.lock is released, with a
+// reference held on each address space to keep it alive.
+int
+procmem(struct procmem *pm, int n)
+{
+  struct vmspace *vm[NPROC];
+  struct proc *p;
+  int i, j;
+
+  i = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && i < n; p++){
+    if(p->state == UNUSED || p->state == EMBRYO || p->pgdir == 0)
+      continue;
+    pm[i].pid = p->pid;
+    safestrcpy(pm[i].name, p->name, sizeof(pm[i].name));
+    pm[i].sz = p->vm->sz;
+    pm[i].nfault = p->nfault;
+    vm[i] = p->vm;
+    vm[i]->ref++;
+    i++;
+  }
+  release(&ptable.lock);
+
+  for(j = 0; j < i; j++){
+    vmcount(vm[j]->pgdir, &pm[j]);
+    vmput(vm[j]);
+  }
+  return i;
+}
+
+// Let p and its threads, held by swaphold(), run again.
+void
+swapdone(struct proc *p)
+{
+  struct proc *q;
+
+  acquire(&ptable.lock);
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q->vm == p->vm && q->state == PAGEOUT)
+      q->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
+// The current process is about to sleep on lk, which is held.
+// Lend the holder our priority if we run ahead of it.
+// Caller holds lk->lk.
+void
+inherit(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+  struct proc *holder = lk->proc;
+
+  acquire(&ptable.lock);
+  p->blockedon = lk;
+  if(holder && holder != p && runsahead(schedattr(p), schedattr(holder)))
+    holder->donor = p;
+  release(&ptable.lock);
+}
+
+// The current process is releasing lk.  Drop what the waiters
+// on lk lent us and keep the highest priority still lent by
+// waiters on other sleeplocks we hold.
+// Caller holds lk->lk.
+void
+disinherit(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+  struct proc *q;
+
+  acquire(&ptable.lock);
+  p->donor = 0;
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++){
+    if(q->state != SLEEPING || q->chan != q->blockedon || q->blockedon == lk)
+      continue;
+    if(q->blockedon->proc != p)
+      continue;
+    if(runsahead(schedattr(q), schedattr(p)))
+      p->donor = q;
+  }
+  release(&ptable.lock);
+}
+
 // A  child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -507,6 +1008,23 @@ sleep(void *chan, struct spinlock *lk)
 }
 
 //PAGEBREAK!
+// Make the sleeping process p runnable.  A stride process
+// banks no credit while asleep: it comes back no further
+// behind than the others, or it would have the cpu to itself
+// until it caught up.  The ptable lock must be held.
+static void
+wake1(struct proc *p)
+{
+  uint pass;
+
+  if(p->policy == 2 && minpass(p, &pass) && (int)(p->pass - pass) < 0)
+    p->pass = pass;
+  if(p->vm && p->vm->stopper && p->vm->stopper != p)
+    p->state = PAGEOUT;
+  else
+    p->state = RUNNABLE;
+}
+
 // Wake up all processes sleeping on chan.
 // The ptable lock must be held.
 static void
@@ -516,7 +1034,7 @@ wakeup1(void *chan)
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+      wake1(p);
 }
 
 // Wake up all processes sleeping on chan.
@@ -542,7 +1060,7 @@ kill(int pid)
       p->killed = 1;
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+        wake1(p);
       release(&ptable.lock);
       return 0;
     }
@@ -564,7 +1082,8 @@ procdump(void)
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
-  [ZOMBIE]    "zombie"
+  [ZOMBIE]    "zombie",
+  [PAGEOUT]   "pgout "
   };
   int i;
   struct proc *p;
@@ -598,17 +1117,26 @@ sched_policy(int pid, int policy)
     //cprintf("loop main p ki pid = %d\n", p->pid);
     //if(p->policy == 0){p->deadline -= p->elapsed_time;}//baaki processes ka elapsed time unki dead
     if(p->pid == pid){
-      	release(&ptable.lock);
+      	acquirewrite(&ptable.attrlock);
       	p->policy = policy;
       	p->arrival_time = (int)ticks;
-      	
       	if(policy==0){
       		p->deadline += p->arrival_time;
+      		}
+      	releasewrite(&ptable.attrlock);
+      	release(&ptable.lock);
+      	
+      	if(policy==0){
       		i = isSchedEDF(p);
       		}
         if(policy==1){
     		i = isSchedRM(p);    
         	}
+        if(policy==2){
+        	acquire(&ptable.lock);
+        	p->pass = stridepass(p);
+        	release(&ptable.lock);
+        	}
       	//cprintf("altered policy of pid %d to %d, deadline = %d\n",p->pid, (p->policy), p->deadline);
       	//release(&ptable.lock);
       	return i;
@@ -626,7 +1154,9 @@ exec_time(int pid, int exec_t)
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
+      acquirewrite(&ptable.attrlock);
       p->exec_time = exec_t;
+      releasewrite(&ptable.attrlock);
       //exec-time of the relevant process set
       //cprintf("altered exec_time of pid %d to %d\n",p->pid, (p->exec_time));
       release(&ptable.lock);
@@ -644,7 +1174,9 @@ deadline(int pid, int deadlin)
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
+      acquirewrite(&ptable.attrlock);
       p->deadline = deadlin;
+      releasewrite(&ptable.attrlock);
       //cprintf("altered deadline of pid %d to %d\n",p->pid, (p->deadline));
       //deadline set, if needed
       release(&ptable.lock);
@@ -662,7 +1194,9 @@ rate(int pid, int rte)
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
+      acquirewrite(&ptable.attrlock);
       p->rate = rte;
+      releasewrite(&ptable.attrlock);
       //rate set, if needed
       release(&ptable.lock);
       return 0;
@@ -672,6 +1206,72 @@ rate(int pid, int rte)
   return -22;
 }
 
+int
+tickets(int pid, int n)
+{
+  struct proc *p;
+  if(n < 1 || n > STRIDE1)
+    return -22;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid == pid){
+      acquirewrite(&ptable.attrlock);
+      p->tickets = n;
+      p->stride = STRIDE1 / n;
+      releasewrite(&ptable.attrlock);
+      //tickets set, shares of stride and lottery procs follow
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -22;
+}
+
+// A process joining the stride class starts at the smallest pass
+// of the stride processes already there, so it can neither
+// monopolize the cpu nor be starved by the time they have banked.
+// Caller holds ptable.lock.
+uint
+stridepass(struct proc *pjoin)
+{
+  uint pass = 0;
+
+  minpass(pjoin, &pass);
+  return pass;
+}
+
+// Set *pass to the smallest pass of the runnable stride
+// processes other than pself.  Returns 0, leaving *pass alone,
+// if there are none.  Caller holds ptable.lock.
+static int
+minpass(struct proc *pself, uint *pass)
+{
+  struct proc *p;
+  int found = 0;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p == pself || p->policy != 2)
+      continue;
+    if(p->state != RUNNABLE && p->state != RUNNING)
+      continue;
+    if(!found || (int)(p->pass - *pass) < 0){
+      *pass = p->pass;
+      found = 1;
+    }
+  }
+  return found;
+}
+
+// Linear congruential generator for lottery draws.
+// Called with ptable.lock held.
+uint
+lotteryrand(void)
+{
+  lotteryseed = lotteryseed * 1103515245 + 12345 + ticks;
+  return lotteryseed >> 1;
+}
+
 int
 rateToWeight(int rate)
 {
@@ -686,7 +1286,7 @@ int isSchedEDF(struct proc *pmaybe){
   int num = 0;
   int denim = 1;
   struct proc *p;
-  acquire(&ptable.lock);
+  acquireread(&ptable.attrlock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
          if(p->policy == 0 && p->pid!=0 &&p->killed ==0){
                 //cprintf("pid %d policy %d exectime %d deadline %d\n",p->pid, p->policy, p->exec_time, p->deadline);
@@ -694,12 +1294,11 @@ int isSchedEDF(struct proc *pmaybe){
 		denim = denim*((p->deadline)-(p->arrival_time));		         
           }
  	} // num/den is sigma(ei/pi)
-  release(&ptable.lock);
+  releaseread(&ptable.attrlock);
         //cprintf("num %d denim %d\n", num, denim);
 	if(num > denim){
 	 //cprintf("Process pid %d isn't schedulable\n", pmaybe->pid);
-	 pmaybe->killed = 1;
-	 pmaybe->state = RUNNABLE;
+	 kill(pmaybe->pid);
 	 return -22;}
 	else{return 0;}
 }
@@ -713,25 +1312,23 @@ int isSchedRM(struct proc *pmaybe){
   int num = 0;
   int tot = 0;
   struct proc *p;
-  acquire(&ptable.lock);
+  acquireread(&ptable.attrlock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
          if(p->policy == 1 && p->killed == 0){
          	num+=1;
          	tot += 10000*(p->exec_time)*(p->rate);	         
           }
  	} // num/den is sigma(ei/pi)
-  release(&ptable.lock);
+  releaseread(&ptable.attrlock);
   //cprintf(" tot %d sched %d process pid %d\n", tot, scheds[num-1], pmaybe->pid);
   if(num > 64){if (tot > 693147){
   			//cprintf("maybe here?\n");
-  			pmaybe->killed = 1;
-  			pmaybe->state = RUNNABLE;
+  			kill(pmaybe->pid);
   			return -22;} 
   		else{return 0;}}
   else if(tot > scheds[num-1]){
         //cprintf("unschedulable\n");
-  	pmaybe->killed = 1;
-  	pmaybe->state = RUNNABLE;
+  	kill(pmaybe->pid);
   	return -22;}
   else{return 0;}
 }
@@ -3,6 +3,7 @@ struct cpu {
   uchar apicid;                // Local APIC ID
   struct context *scheduler;   // swtch() here to enter scheduler
   struct taskstate ts;         // Used by x86 to find stack for interrupt
+  struct taskstate dfts;       // Task that handles double faults
   struct segdesc gdt[NSEGS];   // x86 global descriptor table
   volatile uint started;       // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
@@ -32,12 +33,30 @@ struct context {
   uint eip;
 };
 
-enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE, PAGEOUT };
+
+// A region of user memory whose pages are filled in when
+// first touched: a program segment read from its file, or a
+// mapping made by mmap().
+struct vma {
+  int type;                    // VMA_PROG, VMA_MMAP, or 0 if the slot is free
+  uint start;                  // First address, page-aligned
+  uint end;                    // First address past the region
+  struct inode *ip;            // Backing file, or 0 if anonymous
+  uint off;                    // File offset of start; segment id for VMA_SHM
+  uint filesz;                 // Bytes from the file; the rest reads as zero
+  int prot;                    // PROT_ bits of a VMA_MMAP region
+  int flags;                   // MAP_ bits of a VMA_MMAP region
+};
+
+#define VMA_PROG 1             // program segment, set up by exec()
+#define VMA_MMAP 2             // mapping made by mmap(), placed below KERNBASE
+#define VMA_SHM  3             // shared memory segment attached by shmat()
 
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
-  pde_t* pgdir;                // Page table
+  struct vmspace *vm;          // User memory, shared with threads (vmspace.h)
+  pde_t* pgdir;                // Page table, vm->pgdir
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
@@ -49,13 +68,21 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  int policy;		       //policy, default, EDF or RM
+  int policy;		       //policy, default, EDF, RM, stride or lottery
   int deadline;		       //deadline of the edf if possible
   int exec_time;	       //exec_time of the edf 
   int rate;
   int elapsed_time;
   int ticksproc;		       //rate of the rm process
   int arrival_time;
+  int tickets;		       //share of the cpu for stride and lottery
+  uint stride;		       //STRIDE1/tickets, added to pass on each run
+  uint pass;		       //virtual time of the stride process
+  struct proc *donor;	       //higher priority proc waiting on a sleeplock we hold
+  struct sleeplock *blockedon; //sleeplock this proc last waited on
+  int insyscall;               // In a system call, which may be using user memory
+  uint nfault;                 // Page faults taken, for meminfo()
+  uint ustack;                 // A thread's user stack, from clone(), for join()
 };
 
 // Process memory is laid out contiguously, low addresses first:
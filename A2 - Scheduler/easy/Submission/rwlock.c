@@ -0,0 +1,58 @@
+// Reader-writer spin locks, for data that is scanned often
+// and changed rarely.  Like spinlocks, they are held with
+// interrupts off and must not be held across sleep().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwlock *rw, char *name)
+{
+  initlock(&rw->lk, name);
+  rw->readers = 0;
+}
+
+// Readers pass through lk only to enter, so they run
+// concurrently with each other, but queue behind a writer
+// that holds or is waiting for lk.
+void
+acquireread(struct rwlock *rw)
+{
+  pushcli();
+  acquire(&rw->lk);
+  __sync_fetch_and_add(&rw->readers, 1);
+  release(&rw->lk);
+}
+
+void
+releaseread(struct rwlock *rw)
+{
+  if(rw->readers == 0)
+    panic("releaseread");
+  __sync_fetch_and_sub(&rw->readers, 1);
+  popcli();
+}
+
+// The writer holds lk, which keeps new readers out,
+// and waits for the readers already inside to leave.
+void
+acquirewrite(struct rwlock *rw)
+{
+  acquire(&rw->lk);
+  while(rw->readers != 0)
+    pause();
+  __sync_synchronize();
+}
+
+void
+releasewrite(struct rwlock *rw)
+{
+  release(&rw->lk);
+}
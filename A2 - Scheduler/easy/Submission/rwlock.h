@@ -0,0 +1,7 @@
+// Reader-writer spin lock.  Any number of readers, or one
+// writer, may hold it; a waiting writer keeps new readers out.
+struct rwlock {
+  struct spinlock lk;      // held by the writer, and by readers entering
+  volatile uint readers;   // number of readers holding the lock
+};
+
@@ -0,0 +1,123 @@
+// Test lazy sbrk(): growing the heap costs no memory until it
+// is touched, untouched pages read as zero, the kernel can use
+// untouched pages as read() and write() buffers, and touching
+// memory past the heap still kills the process.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define BIG (16*1024*1024)
+
+// Grow by BIG, touch one page in 64, and compare what that
+// costs with what an eager sbrk() would have allocated.
+void
+footprinttest(void)
+{
+  char *p;
+  int i, before, grown, touched;
+
+  printf(1, "footprint test\n");
+  before = freepages();
+  p = sbrk(BIG);
+  if(p == (char*)-1)
+    fail("sbrk failed");
+  grown = before - freepages();
+  for(i = 0; i < BIG; i += 64*4096){
+    if(p[i] != 0)
+      fail("new heap page is not zero");
+    p[i] = 1;
+  }
+  touched = before - freepages();
+  printf(1, "  sbrk(%d KB) used %d pages; after touching %d pages, %d "
+         "(eager: %d)\n", BIG / 1024, grown, BIG / (64*4096), touched,
+         BIG / 4096);
+  if(grown > 2 || touched > BIG / (64*4096) + 2*(BIG / (4096*1024)) + 2)
+    fail("heap was allocated eagerly");
+  if(sbrk(-BIG) == (char*)-1)
+    fail("sbrk shrink failed");
+  printf(1, "footprint test OK\n");
+}
+
+// System calls read into and write from untouched heap pages,
+// and a forked child sees them as zero too.
+void
+syscalltest(void)
+{
+  char *p;
+  int fd, pid;
+
+  printf(1, "syscall buffer test\n");
+  p = sbrk(3*4096);
+  fd = open("sbrktest.tmp", O_CREATE|O_RDWR);
+  if(fd < 0)
+    fail("open failed");
+  // Untouched pages are written out as zeros ...
+  if(write(fd, p, 4096) != 4096)
+    fail("write from a lazy page failed");
+  close(fd);
+  // ... and can be read into.
+  fd = open("sbrktest.tmp", O_RDONLY);
+  if(fd < 0 || read(fd, p + 4096 + 100, 4096) != 4096)
+    fail("read into a lazy page failed");
+  close(fd);
+  unlink("sbrktest.tmp");
+  if(p[4096 + 100] != 0 || p[2*4096 + 99] != 0)
+    fail("read the wrong data");
+
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    if(p[2*4096 + 4000] != 0)
+      fail("child's lazy page is not zero");
+    p[2*4096 + 4000] = 1;
+    exit();
+  }
+  wait();
+  if(p[2*4096 + 4000] != 0)
+    fail("child's write is visible to the parent");
+  sbrk(-3*4096);
+  printf(1, "syscall buffer test OK\n");
+}
+
+// Touching memory given back with sbrk() must still fault.
+void
+shrinktest(void)
+{
+  char *p;
+  int pid, fds[2];
+  char c;
+
+  printf(1, "shrink test\n");
+  if(pipe(fds) != 0)
+    fail("pipe failed");
+  p = sbrk(4096);
+  p[0] = 1;
+  sbrk(-4096);
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    close(fds[0]);
+    c = p[0];     // should be killed here
+    write(fds[1], &c, 1);
+    exit();
+  }
+  close(fds[1]);
+  if(read(fds[0], &c, 1) != 0)
+    fail("access past the heap did not fault");
+  close(fds[0]);
+  wait();
+  printf(1, "shrink test OK\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  footprinttest();
+  syscalltest();
+  shrinktest();
+  exit();
+}
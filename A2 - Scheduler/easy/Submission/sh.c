@@ -3,6 +3,7 @@
 #include "types.h"
 #include "user.h"
 #include "fcntl.h"
+#include "param.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -49,15 +50,91 @@ struct backcmd {
   struct cmd *cmd;
 };
 
-int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+void runcmd(struct cmd*, int*, int);
 
-// Execute cmd.  Never returns.
+// Commands are started with spawn(), which loads the program
+// into a fresh child without copying the shell's memory.
+// Redirections and pipes are set up in the shell itself and
+// handed to the child as its descriptors 0, 1 and 2.
+
+#define MAXFG 32
+
+int fgpid[MAXFG];  // Foreground children not yet waited for
+int nfg;
+
+// Wait until every foreground child has exited.  Background
+// children are reaped along the way when they finish first.
+void
+waitfg(void)
+{
+  int i, pid;
+
+  while(nfg > 0){
+    if((pid = wait()) < 0){
+      nfg = 0;
+      break;
+    }
+    for(i = 0; i < nfg; i++){
+      if(fgpid[i] == pid){
+        fgpid[i] = fgpid[--nfg];
+        break;
+      }
+    }
+  }
+}
+
+// Does running cmd make the shell wait for part of it?
+// Only a list does, between its parts; a pipe or background
+// job runs any list in it in a child shell.
+int
+haslist(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return 0;
+  if(cmd->type == LIST)
+    return 1;
+  if(cmd->type == REDIR)
+    return haslist(((struct redircmd*)cmd)->cmd);
+  return 0;
+}
+
+// Run cmd in a child shell, which runs its parts in turn
+// while the shell goes on.  The child keeps only the
+// descriptors cmd is given, so that it does not hold a pipe
+// open past the commands using it.
+void
+forkcmd(struct cmd *cmd, int *fd, int background)
+{
+  int i, pid;
+
+  if((pid = fork()) < 0){
+    printf(2, "fork failed\n");
+    return;
+  }
+  if(pid == 0){
+    for(i = 3; i < NOFILE; i++)
+      if(i != fd[0] && i != fd[1] && i != fd[2])
+        close(i);
+    nfg = 0;
+    runcmd(cmd, fd, 0);
+    waitfg();
+    exit();
+  }
+  if(!background && nfg < MAXFG)
+    fgpid[nfg++] = pid;
+}
+
+// Start cmd with the shell's descriptors fd[0..2] as its
+// standard input, output and error.  Does not wait, except
+// between the parts of a list; foreground pids are recorded
+// for waitfg().
 void
-runcmd(struct cmd *cmd)
+runcmd(struct cmd *cmd, int *fd, int background)
 {
-  int p[2];
+  int p[2], cfd[3], f, pid;
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -65,7 +142,7 @@ runcmd(struct cmd *cmd)
   struct redircmd *rcmd;
 
   if(cmd == 0)
-    exit();
+    return;
 
   switch(cmd->type){
   default:
@@ -74,60 +151,65 @@ runcmd(struct cmd *cmd)
   case EXEC:
     ecmd = (struct execcmd*)cmd;
     if(ecmd->argv[0] == 0)
-      exit();
-    exec(ecmd->argv[0], ecmd->argv);
-    printf(2, "exec %s failed\n", ecmd->argv[0]);
+      return;
+    if((pid = spawn(ecmd->argv[0], ecmd->argv, fd, 3)) < 0){
+      printf(2, "exec %s failed\n", ecmd->argv[0]);
+      return;
+    }
+    if(!background && nfg < MAXFG)
+      fgpid[nfg++] = pid;
     break;
 
   case REDIR:
     rcmd = (struct redircmd*)cmd;
-    close(rcmd->fd);
-    if(open(rcmd->file, rcmd->mode) < 0){
+    if((f = open(rcmd->file, rcmd->mode)) < 0){
       printf(2, "open %s failed\n", rcmd->file);
-      exit();
+      return;
     }
-    runcmd(rcmd->cmd);
+    memmove(cfd, fd, sizeof(cfd));
+    cfd[rcmd->fd] = f;
+    runcmd(rcmd->cmd, cfd, background);
+    close(f);
     break;
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(lcmd->left);
-    wait();
-    runcmd(lcmd->right);
+    runcmd(lcmd->left, fd, 0);
+    waitfg();
+    runcmd(lcmd->right, fd, 0);
     break;
 
   case PIPE:
     pcmd = (struct pipecmd*)cmd;
-    if(pipe(p) < 0)
-      panic("pipe");
-    if(fork1() == 0){
-      close(1);
-      dup(p[1]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->left);
-    }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
+    if(pipe(p) < 0){
+      printf(2, "pipe failed\n");
+      return;
     }
+    // Both sides must run at once, so neither may wait.
+    memmove(cfd, fd, sizeof(cfd));
+    cfd[1] = p[1];
+    if(haslist(pcmd->left))
+      forkcmd(pcmd->left, cfd, background);
+    else
+      runcmd(pcmd->left, cfd, background);
+    memmove(cfd, fd, sizeof(cfd));
+    cfd[0] = p[0];
+    if(haslist(pcmd->right))
+      forkcmd(pcmd->right, cfd, background);
+    else
+      runcmd(pcmd->right, cfd, background);
     close(p[0]);
     close(p[1]);
-    wait();
-    wait();
     break;
 
   case BACK:
     bcmd = (struct backcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(bcmd->cmd);
+    if(haslist(bcmd->cmd))
+      forkcmd(bcmd->cmd, fd, 1);
+    else
+      runcmd(bcmd->cmd, fd, 1);
     break;
   }
-  exit();
 }
 
 int
@@ -145,6 +227,8 @@ int
 main(void)
 {
   static char buf[100];
+  static int stdfd[3] = { 0, 1, 2 };
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -158,15 +242,17 @@ main(void)
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
     if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
-      // Chdir must be called by the parent, not the child.
+      // Chdir must be called by the shell itself.
       buf[strlen(buf)-1] = 0;  // chop \n
       if(chdir(buf+3) < 0)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    runcmd(cmd, stdfd, 0);
+    waitfg();
+    freecmd(cmd);
   }
   exit();
 }
@@ -178,17 +264,6 @@ panic(char *s)
   exit();
 }
 
-int
-fork1(void)
-{
-  int pid;
-
-  pid = fork();
-  if(pid == -1)
-    panic("fork");
-  return pid;
-}
-
 //PAGEBREAK!
 // Constructors
 
@@ -259,6 +334,18 @@ backcmd(struct cmd *subcmd)
 //PAGEBREAK!
 // Parsing
 
+// The parser runs in the shell itself now, so a syntax error
+// is reported and the line dropped rather than panicking.
+int parseerr;
+
+void
+syntax(char *msg)
+{
+  if(!parseerr)
+    printf(2, "%s\n", msg);
+  parseerr = 1;
+}
+
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
 
@@ -330,12 +417,17 @@ parsecmd(char *s)
   char *es;
   struct cmd *cmd;
 
+  parseerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     printf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +471,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +499,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +527,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +591,41 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+// Free the nodes of a parsed command.
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
@@ -0,0 +1,208 @@
+// Named shared memory segments.
+//
+// shmget() creates a segment of zeroed pages, or finds an
+// existing one by name, and returns its id.  shmat() maps all
+// of a segment's pages into the calling process, below its
+// mmap() regions, and shmdt() unmaps them.  References are
+// counted: shmget() takes one, held by the address space until
+// its first shmat() of the id turns it into an attachment, so
+// the id cannot be freed and reused in between.  fork() adds
+// one per attachment for the child, exit() and exec() drop the
+// process's attachments and holds, and the last one to go
+// frees the segment.
+// Each page's kalloc() reference count covers the mappings,
+// so a page outlives the segment while still mapped.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
+
+struct shmseg {
+  char name[SHMNAME];
+  int npages;                // 0 if the slot is free
+  int ref;                   // attachments and shmget() holds
+  char *pages[SHMMAXPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Return the id of the segment called name, creating it with
+// size bytes if there is none, and hold it for p's address
+// space until shmat().  An existing segment must be at least
+// size bytes.  Returns -1 on error.
+int
+shmget(struct proc *p, char *name, uint size)
+{
+  struct shmseg *s, *free;
+  int i, id, npages;
+
+  npages = PGROUNDUP(size) / PGSIZE;
+  if(npages == 0 || npages > SHMMAXPAGES || size > SHMMAXPAGES*PGSIZE)
+    return -1;
+
+  acquiresleep(&p->vm->lock);
+  acquire(&shmtab.lock);
+  free = 0;
+  for(s = shmtab.seg; s < &shmtab.seg[NSHM]; s++){
+    if(s->npages == 0){
+      if(free == 0)
+        free = s;
+      continue;
+    }
+    if(strncmp(s->name, name, SHMNAME) == 0)
+      break;
+  }
+  if(s < &shmtab.seg[NSHM]){
+    if(s->npages < npages)
+      goto bad;
+  } else {
+    if((s = free) == 0)
+      goto bad;
+    for(i = 0; i < npages; i++){
+      if((s->pages[i] = kalloc_zeroed()) == 0){
+        while(--i >= 0)
+          kfree(s->pages[i]);
+        goto bad;
+      }
+    }
+    safestrcpy(s->name, name, SHMNAME);
+    s->npages = npages;
+    s->ref = 0;
+  }
+  id = s - shmtab.seg;
+  if((p->vm->shmheld & (1 << id)) == 0){
+    p->vm->shmheld |= 1 << id;
+    s->ref++;
+  }
+  release(&shmtab.lock);
+  releasesleep(&p->vm->lock);
+  return id;
+
+bad:
+  release(&shmtab.lock);
+  releasesleep(&p->vm->lock);
+  return -1;
+}
+
+// Take another attachment to segment id, e.g. for fork().
+void
+shmdup(int id)
+{
+  acquire(&shmtab.lock);
+  shmtab.seg[id].ref++;
+  release(&shmtab.lock);
+}
+
+// Drop an attachment to segment id, freeing the segment
+// with the last one.
+void
+shmput(int id)
+{
+  struct shmseg *s;
+  int i;
+
+  acquire(&shmtab.lock);
+  s = &shmtab.seg[id];
+  if(--s->ref == 0){
+    for(i = 0; i < s->npages; i++)
+      kfree(s->pages[i]);
+    s->npages = 0;
+  }
+  release(&shmtab.lock);
+}
+
+// Map segment id into p.  Returns the address, or -1.
+int
+shmat(struct proc *p, int id)
+{
+  struct shmseg *s;
+  struct vma *v;
+  uint start, len, a;
+  int i;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  acquiresleep(&p->vm->lock);
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++)
+    if(v->type == 0)
+      break;
+  if(v == &p->vm->vma[NVMA]){
+    releasesleep(&p->vm->lock);
+    return -1;
+  }
+
+  acquire(&shmtab.lock);
+  s = &shmtab.seg[id];
+  len = s->npages * PGSIZE;
+  start = mmapbase(p);
+  if(s->npages == 0 || start < len || start - len < PGROUNDUP(p->vm->sz)){
+    release(&shmtab.lock);
+    releasesleep(&p->vm->lock);
+    return -1;
+  }
+  start -= len;
+  for(i = 0, a = start; i < s->npages; i++, a += PGSIZE){
+    if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(s->pages[i]), PTE_W|PTE_U) < 0){
+      deallocuvm(p->pgdir, a, start);
+      release(&shmtab.lock);
+      releasesleep(&p->vm->lock);
+      return -1;
+    }
+    kincref(s->pages[i]);
+  }
+  // The attachment takes over our shmget() hold, if any.
+  if(p->vm->shmheld & (1 << id))
+    p->vm->shmheld &= ~(1 << id);
+  else
+    s->ref++;
+  release(&shmtab.lock);
+
+  v->type = VMA_SHM;
+  v->start = start;
+  v->end = start + len;
+  v->ip = 0;
+  v->off = id;
+  v->filesz = 0;
+  releasesleep(&p->vm->lock);
+  return start;
+}
+
+// Unmap the segment attached at addr from p.
+int
+shmdt(struct proc *p, uint addr)
+{
+  struct vma *v;
+
+  acquiresleep(&p->vm->lock);
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++)
+    if(v->type == VMA_SHM && v->start == addr)
+      break;
+  if(v == &p->vm->vma[NVMA]){
+    releasesleep(&p->vm->lock);
+    return -1;
+  }
+  vmstop(p->vm);
+  deallocuvm(p->pgdir, v->end, v->start);
+  lcr3(V2P(p->pgdir));
+  vmresume(p->vm);
+  shmput(v->off);
+  v->type = 0;
+  releasesleep(&p->vm->lock);
+  return 0;
+}
@@ -0,0 +1,139 @@
+// Shared memory segments: check that they are shared across
+// fork() and by name, then time moving NMB megabytes from one
+// process to another through a shared-memory ring and through
+// a pipe.  The ring's two sides spin, so use more than one
+// cpu, e.g. "make qemu CPUS=2".
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NMB      4
+#define CHUNK    4096
+#define RINGSIZE (15*4096)
+
+struct ring {
+  volatile uint head;     // bytes written by the producer
+  volatile uint tail;     // bytes read by the consumer
+  char data[RINGSIZE];
+};
+
+char buf[CHUNK];
+
+void
+sharetest(void)
+{
+  int id, id2, pid;
+  char *p, *q;
+
+  printf(1, "shared memory test\n");
+  if((id = shmget("shmtest", 8192)) < 0)
+    fail("shmget failed");
+  if((p = shmat(id)) == (char*)-1)
+    fail("shmat failed");
+  if(p[0] != 0 || p[8191] != 0)
+    fail("new segment is not zero");
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    // Inherited across fork, and attachable again by name.
+    p[0] = 'c';
+    if((id2 = shmget("shmtest", 100)) != id)
+      fail("shmget by name found another segment");
+    if((q = shmat(id2)) == (char*)-1)
+      fail("second shmat failed");
+    q[8191] = 'q';
+    shmdt(q);
+    exit();
+  }
+  wait();
+  if(p[0] != 'c' || p[8191] != 'q')
+    fail("child's writes are not visible");
+  if(shmdt(p) < 0)
+    fail("shmdt failed");
+  // The last detach freed it; the name makes a new one.
+  id = shmget("shmtest", 4096);
+  p = shmat(id);
+  if(p == (char*)-1 || p[0] != 0)
+    fail("segment survived its last detach");
+  shmdt(p);
+  printf(1, "shared memory test OK\n");
+}
+
+// Send NMB megabytes into the ring or the pipe, and check
+// the sum of what arrives.
+int
+transfer(struct ring *r, int fds[2])
+{
+  uint total, n, i, sum, got, off, m;
+  int pid, start;
+
+  total = NMB * 1024 * 1024;
+  start = uptime();
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    for(i = 0; i < CHUNK; i++)
+      buf[i] = i;
+    for(n = 0; n < total; n += CHUNK){
+      if(r == 0){
+        if(write(fds[1], buf, CHUNK) != CHUNK)
+          fail("pipe write failed");
+        continue;
+      }
+      while(r->head - r->tail > RINGSIZE - CHUNK)
+        ;
+      off = r->head % RINGSIZE;
+      m = RINGSIZE - off < CHUNK ? RINGSIZE - off : CHUNK;
+      memmove(r->data + off, buf, m);
+      memmove(r->data, buf + m, CHUNK - m);
+      r->head += CHUNK;
+    }
+    exit();
+  }
+
+  sum = 0;
+  for(got = 0; got < total; got += n){
+    if(r == 0){
+      if((n = read(fds[0], buf, CHUNK)) <= 0)
+        fail("pipe read failed");
+      for(i = 0; i < n; i++)
+        sum += (uchar)buf[i];
+      continue;
+    }
+    while(r->head == r->tail)
+      ;
+    n = r->head - r->tail;
+    for(i = 0; i < n; i++)
+      sum += (uchar)r->data[(r->tail + i) % RINGSIZE];
+    r->tail += n;
+  }
+  wait();
+  if(sum != (total / CHUNK) * (CHUNK / 256) * (255 * 256 / 2))
+    fail("data arrived corrupted");
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct ring *r;
+  int fds[2], id, t;
+
+  sharetest();
+
+  if((id = shmget("shmbench", sizeof(struct ring))) < 0 ||
+     (r = shmat(id)) == (struct ring*)-1)
+    fail("cannot attach ring");
+  t = transfer(r, 0);
+  printf(1, "%d MB through shared memory: %d ticks\n", NMB, t);
+  shmdt(r);
+
+  if(pipe(fds) != 0)
+    fail("pipe failed");
+  t = transfer(0, fds);
+  printf(1, "%d MB through a pipe: %d ticks\n", NMB, t);
+  exit();
+}
@@ -0,0 +1,229 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size, carved from
+// slabs: pages from kalloc() that start with a struct slab
+// and hold as many objects as fit after it.  Each cpu keeps
+// a few free objects of every cache, so most allocations and
+// frees take no lock.  An optional constructor runs once per
+// object when its slab is made, and objects must be freed in
+// their constructed state, so that e.g. a pipe's lock is set
+// up once rather than on every pipealloc().
+//
+// kmalloc() serves any size up to KMALLOC_MAX from one cache
+// per power of two; kmfree() finds the cache from the slab.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct slab *next;         // on the cache's partial list
+  struct slab *prev;
+  struct kmem_cache *cache;
+  void *free;                // free objects in this slab
+  uint inuse;                // objects not on free, incl. cpu-held ones
+};
+
+#define SLABHDR   ((sizeof(struct slab) + 7) & ~7)
+#define LINK(c, o) (*(void**)((char*)(o) + (c)->linkoff))
+
+#define KMALLOC_MIN 16
+#define KMALLOC_MAX 1024
+#define NKMALLOC    7        // caches of 16, 32, ..., KMALLOC_MAX bytes
+
+static struct kmem_cache kmalloccache[NKMALLOC];
+static char *kmallocname[NKMALLOC] = {
+  "kmalloc16", "kmalloc32", "kmalloc64", "kmalloc128",
+  "kmalloc256", "kmalloc512", "kmalloc1024",
+};
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size, void (*ctor)(void*))
+{
+  memset(c, 0, sizeof(*c));
+  c->name = name;
+  c->size = size;
+  c->stride = (size + 7) & ~7;
+  c->linkoff = 0;
+  if(ctor){
+    // Keep the free list link out of the constructed fields.
+    c->linkoff = c->stride;
+    c->stride += 8;
+  }
+  if(c->stride < sizeof(void*))
+    c->stride = sizeof(void*);
+  c->perslab = (PGSIZE - SLABHDR) / c->stride;
+  if(c->perslab == 0)
+    panic("kmem_cache_init");
+  c->ctor = ctor;
+  initlock(&c->lock, name);
+}
+
+static void
+slabpush(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+static void
+slabremove(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Make a slab of constructed free objects.
+static struct slab*
+newslab(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *o;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->free = 0;
+  s->inuse = 0;
+  o = (char*)s + SLABHDR;
+  for(i = 0; i < c->perslab; i++, o += c->stride){
+    if(c->ctor)
+      c->ctor(o);
+    LINK(c, o) = s->free;
+    s->free = o;
+  }
+  return s;
+}
+
+// Take an object from the slabs, making a new slab if
+// they are all full.  Caller holds c->lock.
+static void*
+slaballoc(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *o;
+
+  if((s = c->partial) == 0){
+    if((s = newslab(c)) == 0)
+      return 0;
+    slabpush(c, s);
+    c->nslabs++;
+  }
+  o = s->free;
+  s->free = LINK(c, o);
+  s->inuse++;
+  if(s->free == 0)
+    slabremove(c, s);
+  return o;
+}
+
+// Return an object to its slab, and the slab to kalloc()
+// once it is empty, unless it is the cache's last free
+// space.  Caller holds c->lock.
+static void
+slabfree(struct kmem_cache *c, void *o)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)o);
+  if(s->free == 0)
+    slabpush(c, s);
+  LINK(c, o) = s->free;
+  s->free = o;
+  s->inuse--;
+  if(s->inuse == 0 && (c->partial != s || s->next != 0)){
+    slabremove(c, s);
+    c->nslabs--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate an object from cache c.
+// Returns 0 if the memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *o;
+  int id;
+
+  pushcli();
+  id = cpuid();
+  if(c->cpu[id].n == 0){
+    acquire(&c->lock);
+    while(c->cpu[id].n < KMC_BATCH && (o = slaballoc(c)) != 0)
+      c->cpu[id].obj[c->cpu[id].n++] = o;
+    release(&c->lock);
+  }
+  o = 0;
+  if(c->cpu[id].n > 0)
+    o = c->cpu[id].obj[--c->cpu[id].n];
+  popcli();
+  return o;
+}
+
+// Free an object allocated from cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  int id;
+
+  if(((struct slab*)PGROUNDDOWN((uint)o))->cache != c)
+    panic("kmem_cache_free");
+
+  pushcli();
+  id = cpuid();
+  if(c->cpu[id].n == KMC_NCPU){
+    acquire(&c->lock);
+    while(c->cpu[id].n > KMC_NCPU - KMC_BATCH)
+      slabfree(c, c->cpu[id].obj[--c->cpu[id].n]);
+    release(&c->lock);
+  }
+  c->cpu[id].obj[c->cpu[id].n++] = o;
+  popcli();
+}
+
+void
+kmallocinit(void)
+{
+  int i;
+
+  for(i = 0; i < NKMALLOC; i++)
+    kmem_cache_init(&kmalloccache[i], kmallocname[i], KMALLOC_MIN << i, 0);
+}
+
+// Allocate n bytes of kernel memory, 8-byte aligned.
+// Returns 0 if n is more than KMALLOC_MAX or the memory
+// cannot be allocated; use kalloc() for whole pages.
+void*
+kmalloc(uint n)
+{
+  int i;
+
+  if(n > KMALLOC_MAX)
+    return 0;
+  for(i = 0; (KMALLOC_MIN << i) < n; i++)
+    ;
+  return kmem_cache_alloc(&kmalloccache[i]);
+}
+
+// Free memory returned by kmalloc().
+void
+kmfree(void *p)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)p);
+  kmem_cache_free(s->cache, p);
+}
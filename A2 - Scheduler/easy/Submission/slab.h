@@ -0,0 +1,21 @@
+// Cache of equal-sized kernel objects; see slab.c.
+// Needs spinlock.h and param.h.
+
+#define KMC_NCPU  8   // free objects each cpu keeps per cache
+#define KMC_BATCH 4   // objects moved between a cpu and the slabs at once
+
+struct kmem_cache {
+  char *name;              // also names the lock
+  uint size;               // bytes per object, as asked for
+  uint stride;             // bytes between objects in a slab
+  uint linkoff;            // where a free object keeps its next pointer
+  uint perslab;            // objects per slab
+  void (*ctor)(void*);     // run once per object when its slab is made
+  struct spinlock lock;    // protects partial, nslabs
+  struct slab *partial;    // slabs with free objects
+  uint nslabs;             // slabs (pages) in use
+  struct {                 // free objects kept by each cpu
+    void *obj[KMC_NCPU];
+    int n;
+  } cpu[NCPU];
+};
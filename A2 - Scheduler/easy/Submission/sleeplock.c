@@ -17,17 +17,67 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->proc = 0;
+  lk->stat = lockcountfor(name);
+}
+
+// Is lk held by a process running on another cpu?
+// Reads without lk->lk, so the answer is only a hint.
+static int
+holderrunning(struct sleeplock *lk, struct proc *me)
+{
+  struct proc *p;
+
+  p = *(struct proc * volatile *)&lk->proc;
+  return p != 0 && p != me && *(volatile enum procstate*)&p->state == RUNNING;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *me = myproc();
+  int spun, slept;
+  uint64 start, spin;
+
+  spun = slept = 0;
+  spin = 0;
   acquire(&lk->lk);
   while (lk->locked) {
+    if(holderrunning(lk, me)){
+      // The holder is running on another cpu, so rather than
+      // sleep, spin with lk->lk released and interrupts on
+      // until it lets go or stops running.  lockstat reports
+      // how many acquisitions spun and how many slept.
+      release(&lk->lk);
+      start = rdtsc();
+      while(*(volatile uint*)&lk->locked && holderrunning(lk, me))
+        pause();
+      spin += rdtsc() - start;
+      spun = 1;
+      acquire(&lk->lk);
+      continue;
+    }
+    // Lend our priority to the holder so that a real-time
+    // process does not wait behind everything the holder
+    // would otherwise wait behind.
+    inherit(lk);
     sleep(lk, &lk->lk);
+    slept = 1;
   }
   lk->locked = 1;
-  lk->pid = myproc()->pid;
+  lk->pid = me->pid;
+  lk->proc = me;
+  if(lk->stat){
+    __sync_fetch_and_add(&lk->stat->nacquire, 1);
+    if(spun || slept){
+      __sync_fetch_and_add(&lk->stat->ncontend, 1);
+      __sync_fetch_and_add(&lk->stat->spin, spin);
+      if(slept)
+        __sync_fetch_and_add(&lk->stat->nsleep, 1);
+      else
+        __sync_fetch_and_add(&lk->stat->nspin, 1);
+    }
+  }
   release(&lk->lk);
 }
 
@@ -37,6 +87,8 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->proc = 0;
+  disinherit(lk);
   wakeup(lk);
   release(&lk->lk);
 }
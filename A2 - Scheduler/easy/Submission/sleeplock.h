@@ -6,5 +6,7 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  struct proc *proc; // Process holding lock, lends it priority
+  struct lockcount *stat; // Contention counters for locks of this name
 };
 
@@ -8,29 +8,75 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+static struct lockcount lockcounts[NLOCKSTAT];
+static uint lockcountslock;  // initlock() may run before mycpu() works
+
+// Find or make the counters for locks called name.
+// Returns 0 if the table is full; such locks are not counted.
+struct lockcount*
+lockcountfor(char *name)
+{
+  struct lockcount *c;
+  uint eflags;
+
+  eflags = readeflags();
+  cli();
+  while(xchg(&lockcountslock, 1) != 0)
+    ;
+  for(c = lockcounts; c < &lockcounts[NLOCKSTAT]; c++){
+    if(c->name == 0){
+      c->name = name;
+      break;
+    }
+    if(strncmp(c->name, name, sizeof(((struct lockstat*)0)->name)) == 0)
+      break;
+  }
+  xchg(&lockcountslock, 0);
+  if(eflags & FL_IF)
+    sti();
+  if(c == &lockcounts[NLOCKSTAT])
+    return 0;
+  return c;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->stat = lockcountfor(name);
 }
 
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
 // Holding a lock for a long time may cause
 // other CPUs to waste time spinning to acquire it.
+// Waiting CPUs get the lock in the order they asked for it.
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 start, spin;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // Take a ticket and wait for it to be served.  The xadd is
+  // atomic; while waiting we only read owner, so the cache line
+  // is written once per hand-over instead of once per spin.
+  ticket = xadd(&lk->next, 1);
+  spin = 0;
+  if(lk->owner != ticket){
+    start = rdtsc();
+    while(lk->owner != ticket)
+      pause();
+    spin = rdtsc() - start;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +86,14 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  if(lk->stat){
+    __sync_fetch_and_add(&lk->stat->nacquire, 1);
+    if(spin){
+      __sync_fetch_and_add(&lk->stat->ncontend, 1);
+      __sync_fetch_and_add(&lk->stat->spin, spin);
+    }
+  }
 }
 
 // Release the lock.
@@ -59,10 +113,10 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket, equivalent to lk->owner++.
+  // Only the holder writes owner, so the increment need not
+  // be locked, but it must be a single store.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
@@ -91,7 +145,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->next != lock->owner && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -124,3 +178,24 @@ popcli(void)
     sti();
 }
 
+// Copy the counters of up to n lock names into ls.
+// Returns the number of entries copied.
+int
+lockstat(struct lockstat *ls, int n)
+{
+  struct lockcount *c;
+  int i;
+
+  for(i = 0, c = lockcounts; i < n && c < &lockcounts[NLOCKSTAT]; c++){
+    if(c->name == 0)
+      break;
+    safestrcpy(ls[i].name, c->name, sizeof(ls[i].name));
+    ls[i].nacquire = c->nacquire;
+    ls[i].ncontend = c->ncontend;
+    ls[i].kcycles = c->spin >> 10;
+    ls[i].nspin = c->nspin;
+    ls[i].nsleep = c->nsleep;
+    i++;
+  }
+  return i;
+}
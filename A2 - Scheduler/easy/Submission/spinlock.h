@@ -1,11 +1,28 @@
 // Mutual exclusion lock.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;  // Next ticket to hand out
+  volatile uint owner; // Ticket being served; held while next != owner
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+  struct lockcount *stat; // Contention counters for locks of this name
 };
 
+// Contention counters shared by all locks with the same name,
+// spin locks and sleep locks alike.  Locks of one name (e.g.
+// "pipe") can be held on several cpus at once, so the counters
+// are updated atomically.  Each entry gets its own cache line so
+// that counting on one lock does not slow down cpus working on
+// another.
+struct lockcount {
+  char *name;
+  uint nacquire;
+  uint ncontend;
+  uint64 spin;       // cycles spent waiting
+  uint nspin;        // sleep lock waits that only spun
+  uint nsleep;       // sleep lock waits that slept
+} __attribute__((aligned(64)));
+
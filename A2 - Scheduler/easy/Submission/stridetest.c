@@ -0,0 +1,118 @@
+// Test that the stride and lottery policies divide the cpu in
+// proportion to tickets.  The children only compete with each
+// other on a single cpu, so run it with CPUS=1.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NCHILD     3
+#define TOLERANCE  5     // allowed error, in percentage points
+#define NTICKS     10000 // length of the measurement
+
+int shares[NCHILD] = { 50, 30, 20 };
+
+struct report {
+  int child;
+  int count;
+};
+
+// Burn cpu until the clock reaches end, counting rounds of work.
+int
+spin(int end)
+{
+  int n;
+  volatile int i;
+
+  n = 0;
+  while(uptime() < end){
+    for(i = 0; i < 10000; i++)
+      ;
+    n++;
+  }
+  return n;
+}
+
+// Run NCHILD cpu-bound children under policy for nticks clock
+// ticks and check that each got its share of the rounds.
+int
+sharetest(char *name, int policy, int nticks)
+{
+  int fds[2], counts[NCHILD];
+  int i, pid, start, total, pct, err;
+  struct report r;
+
+  printf(1, "%s test, shares %d/%d/%d over %d ticks\n", name,
+         shares[0], shares[1], shares[2], nticks);
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+
+  // Let every child get its tickets and policy before any spins.
+  start = uptime() + 10;
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      sleep(start - uptime());
+      r.child = i;
+      r.count = spin(start + nticks);
+      write(fds[1], &r, sizeof(r));
+      exit();
+    }
+    if(tickets(pid, shares[i]) < 0 || sched_policy(pid, policy) < 0){
+      printf(1, "could not make pid %d %s\n", pid, name);
+      exit();
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  for(i = 0; i < NCHILD; i++){
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r)){
+      printf(1, "short read from child\n");
+      exit();
+    }
+    counts[r.child] = r.count;
+    total += r.count;
+  }
+  close(fds[0]);
+  for(i = 0; i < NCHILD; i++)
+    wait();
+
+  if(total == 0){
+    printf(1, "%s test: children did no work\n", name);
+    return -1;
+  }
+  err = 0;
+  for(i = 0; i < NCHILD; i++){
+    pct = counts[i] * 100 / total;
+    printf(1, "  child %d: %d tickets, %d%% of the cpu\n", i, shares[i], pct);
+    if(pct < shares[i] - TOLERANCE || pct > shares[i] + TOLERANCE)
+      err = 1;
+  }
+  if(err){
+    printf(1, "%s test failed\n", name);
+    return -1;
+  }
+  printf(1, "%s test OK\n", name);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nticks;
+
+  nticks = NTICKS;
+  if(argc > 1)
+    nticks = atoi(argv[1]);
+  sharetest("stride", 2, nticks);
+  sharetest("lottery", 3, nticks);
+  exit();
+}
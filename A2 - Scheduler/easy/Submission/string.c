@@ -12,6 +12,8 @@ memset(void *dst, int c, uint n)
   return dst;
 }
 
+// Compare a word at a time, then find the first differing
+// byte within the word.
 int
 memcmp(const void *v1, const void *v2, uint n)
 {
@@ -19,6 +21,10 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  while(n >= 4 && *(uint*)s1 == *(uint*)s2){
+    s1 += 4, s2 += 4;
+    n -= 4;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -28,22 +34,41 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// Copy with rep movsl when src and dst can be aligned together,
+// moving the odd bytes at either end with rep movsb.  Copies
+// downward if dst overlaps the end of src.
 void*
 memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  uint m;
 
   s = src;
   d = dst;
   if(s < d && s + n > d){
     s += n;
     d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+    if((uint)s % 4 == (uint)d % 4 && n >= 4){
+      m = (uint)d % 4;
+      s -= m, d -= m, n -= m;
+      movsbr(d + m - 1, s + m - 1, m);
+      movslr(d - 4, s - 4, n / 4);
+      s -= n & ~3, d -= n & ~3;
+      n %= 4;
+    }
+    movsbr(d - 1, s - 1, n);
+  } else {
+    if((uint)s % 4 == (uint)d % 4 && n >= 4){
+      m = (4 - (uint)d % 4) % 4;
+      movsb(d, s, m);
+      s += m, d += m, n -= m;
+      movsl(d, s, n / 4);
+      s += n & ~3, d += n & ~3;
+      n %= 4;
+    }
+    movsb(d, s, n);
+  }
 
   return dst;
 }
@@ -103,3 +128,74 @@ strlen(const char *s)
   return n;
 }
 
+
+#ifdef MEMBENCH
+#include "defs.h"
+#include "mmu.h"
+#include "fs.h"
+
+// The byte-at-a-time versions, to compare against.
+static void
+bytemove(char *d, const char *s, uint n)
+{
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+static int
+bytecmp(const uchar *s1, const uchar *s2, uint n)
+{
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+  return 0;
+}
+
+#define NREP 200
+
+// Print cycles per KB for byte-loop and word copies and
+// compares of a disk block and half a page, aligned and not.
+// Run once at boot by "make MEMBENCH=1".
+void
+membench(void)
+{
+  static uint size[] = { BSIZE, PGSIZE/2 };
+  char *a, *b;
+  uint64 t0, t1, t2, t3, t4;
+  uint kb;
+  int i, j, off;
+
+  if((a = kalloc()) == 0 || (b = kalloc()) == 0)
+    panic("membench");
+  memset(a, 0x5a, PGSIZE);
+  cprintf("membench: cycles/KB   bytemove memmove bytecmp memcmp\n");
+  for(i = 0; i < NELEM(size); i++){
+    kb = NREP * size[i] / 1024;
+    for(off = 0; off < 2; off++){
+      t0 = rdtsc();
+      for(j = 0; j < NREP; j++)
+        bytemove(b + off, a, size[i]);
+      t1 = rdtsc();
+      for(j = 0; j < NREP; j++)
+        memmove(b + off, a, size[i]);
+      t2 = rdtsc();
+      for(j = 0; j < NREP; j++)
+        if(bytecmp((uchar*)b + off, (uchar*)a, size[i]) != 0)
+          panic("membench cmp");
+      t3 = rdtsc();
+      for(j = 0; j < NREP; j++)
+        if(memcmp(b + off, a, size[i]) != 0)
+          panic("membench cmp");
+      t4 = rdtsc();
+      cprintf("membench: %d bytes%s %d %d %d %d\n", size[i],
+              off ? " unaligned" : "",
+              (uint)(t1 - t0) / kb, (uint)(t2 - t1) / kb,
+              (uint)(t3 - t2) / kb, (uint)(t4 - t3) / kb);
+    }
+  }
+  kfree(a);
+  kfree(b);
+}
+#endif
@@ -0,0 +1,180 @@
+// Swap space: user pages paged out to disk.
+//
+// When kalloc() runs out of pages for user memory, ualloc()
+// pages out a batch of some process's pages (see pageout() in
+// vm.c) and tries again.  A paged-out page's PTE is left
+// without PTE_P but with PTE_SWAP and the number of the slot
+// holding it, and the next fault on it reads it back.
+//
+// The swap area is the SWAPSIZE blocks that follow the file
+// system on its disk; slot i is the page in the SPB blocks
+// from FSSIZE + i*SPB.  Swap I/O bypasses the buffer cache.
+// fork() can leave several PTEs naming the same slot, so each
+// slot has a reference count.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
+#include "fs.h"
+#include "buf.h"
+#include "swapinfo.h"
+
+#define SPB       (PGSIZE/BSIZE)   // blocks per slot
+#define NSLOT     (SWAPSIZE/SPB)
+#define SWAPBATCH 16               // pages paged out at once
+
+struct {
+  struct spinlock lock;
+  uchar ref[NSLOT];
+  uint nused;
+  uint npageout;
+  uint npagein;
+} swap;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+}
+
+// Allocate a slot.  Returns -1 if swap is full.
+int
+swapalloc(void)
+{
+  int i;
+
+  acquire(&swap.lock);
+  for(i = 0; i < NSLOT; i++){
+    if(swap.ref[i] == 0){
+      swap.ref[i] = 1;
+      swap.nused++;
+      release(&swap.lock);
+      return i;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Take another reference to slot i, for a PTE copied by fork().
+void
+swapdup(uint i)
+{
+  acquire(&swap.lock);
+  if(i >= NSLOT || swap.ref[i] == 0 || swap.ref[i] == 255)
+    panic("swapdup");
+  swap.ref[i]++;
+  release(&swap.lock);
+}
+
+// Drop a reference to slot i.
+void
+swapfree(uint i)
+{
+  acquire(&swap.lock);
+  if(i >= NSLOT || swap.ref[i] == 0)
+    panic("swapfree");
+  if(--swap.ref[i] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// Move the page at mem to or from slot i.
+static void
+swaprw(uint i, char *mem, int write)
+{
+  struct buf b;
+  int j;
+
+  memset(&b, 0, sizeof(b));
+  initsleeplock(&b.lock, "swap");
+  acquiresleep(&b.lock);
+  b.dev = ROOTDEV;
+  for(j = 0; j < SPB; j++){
+    b.blockno = FSSIZE + i*SPB + j;
+    if(write){
+      memmove(b.data, mem + j*BSIZE, BSIZE);
+      b.flags = B_DIRTY;
+    } else {
+      b.flags = 0;
+    }
+    iderw(&b);
+    if(!write)
+      memmove(mem + j*BSIZE, b.data, BSIZE);
+  }
+  releasesleep(&b.lock);
+}
+
+// Write the page at mem to slot i.  Sleeps.
+void
+swapwrite(uint i, char *mem)
+{
+  swaprw(i, mem, 1);
+  __sync_fetch_and_add(&swap.npageout, 1);
+}
+
+// Read slot i into the page at mem.  Sleeps.
+void
+swapread(uint i, char *mem)
+{
+  swaprw(i, mem, 0);
+  __sync_fetch_and_add(&swap.npagein, 1);
+}
+
+// Page out a batch of pages: from a process waiting to return
+// to user space, or, failing that, from the current process if
+// it is handling a fault from user space rather than a system
+// call and has no threads that could be using its memory.
+// Returns the number of pages freed.
+static int
+swapout(void)
+{
+  struct proc *p;
+  int i, n;
+
+  for(i = 0; i < NPROC; i++){
+    if((p = swaphold()) == 0)
+      break;
+    n = pageout(p, SWAPBATCH);
+    swapdone(p);
+    if(n > 0)
+      return n;
+  }
+  p = myproc();
+  if(p == 0 || p->insyscall || p->vm->nlive > 1)
+    return 0;
+  n = pageout(p, SWAPBATCH);
+  lcr3(V2P(p->pgdir));
+  return n;
+}
+
+// Allocate a page for user memory, like kalloc(), or like
+// kalloc_zeroed() if zero is set, but page out other pages to
+// make room if memory has run out.  May sleep, so the caller
+// must hold no spinlocks.
+char*
+ualloc(int zero)
+{
+  char *mem;
+
+  while((mem = zero ? kalloc_zeroed() : kalloc()) == 0)
+    if(swapout() == 0)
+      return 0;
+  return mem;
+}
+
+void
+kswapinfo(struct swapinfo *si)
+{
+  si->nslots = NSLOT;
+  si->nused = swap.nused;
+  si->npageout = swap.npageout;
+  si->npagein = swap.npagein;
+}
@@ -0,0 +1,9 @@
+// Swap space use, as returned by the swapinfo() system call.
+// Both the kernel and user programs use this header file.
+
+struct swapinfo {
+  uint nslots;     // pages the swap area holds
+  uint nused;      // slots holding a paged-out page
+  uint npageout;   // pages written to swap since boot
+  uint npagein;    // pages read back by page faults since boot
+};
@@ -0,0 +1,110 @@
+// Stress test for swapping: NCHILD processes together touch
+// twice as many pages as are free, sweeping their memory
+// NPASS times and checking every page survived being paged
+// out and back in.  Reports throughput and paging rates.
+// Swap is smaller than PHYSTOP's worth of memory, so run it
+// on a small machine, e.g. "make qemu MEM=32"; given less
+// swap than it needs, it oversubscribes as far as swap allows.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "swapinfo.h"
+
+#define NCHILD 4
+#define NPASS  3
+#define PGSIZE 4096
+
+// Fill npages pages, then sweep them NPASS times, checking
+// what the previous sweep left in each.
+int
+child(int id, int npages)
+{
+  char *mem;
+  uint *w;
+  int i, pass;
+
+  mem = sbrk(npages * PGSIZE);
+  if(mem == (char*)-1){
+    printf(1, "swaptest: child %d: sbrk failed\n", id);
+    return -1;
+  }
+  for(pass = 0; pass <= NPASS; pass++){
+    for(i = 0; i < npages; i++){
+      w = (uint*)(mem + i*PGSIZE);
+      if(pass > 0 && (w[0] != (id << 24 | i) || w[PGSIZE/4-1] != pass-1)){
+        printf(1, "swaptest: child %d: page %d corrupt in pass %d\n",
+               id, i, pass);
+        return -1;
+      }
+      w[0] = id << 24 | i;
+      w[PGSIZE/4-1] = pass;
+    }
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct swapinfo before, after;
+  int fds[2], i, pid, nfree, npages, nok, start, t;
+  char c;
+
+  if(swapinfo(&before) < 0){
+    printf(1, "swapinfo failed\n");
+    exit();
+  }
+  nfree = freepages();
+  // Leave some swap and memory for page tables and the kernel.
+  npages = 2 * nfree;
+  if(npages > nfree + (before.nslots - before.nused) * 9 / 10)
+    npages = nfree + (before.nslots - before.nused) * 9 / 10;
+  npages = npages / NCHILD;
+  printf(1, "swaptest: %d free pages, %d swap slots; %d children x %d pages"
+         " (%d%% of free memory)\n", nfree, before.nslots - before.nused,
+         NCHILD, npages, npages * NCHILD * 100 / nfree);
+
+  if(pipe(fds) != 0){
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  start = uptime();
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      if(child(i, npages) == 0)
+        write(fds[1], "k", 1);
+      exit();
+    }
+  }
+  close(fds[1]);
+  nok = 0;
+  while(read(fds[0], &c, 1) == 1)
+    nok++;
+  for(i = 0; i < NCHILD; i++)
+    wait();
+  t = uptime() - start;
+  swapinfo(&after);
+
+  if(t == 0)
+    t = 1;
+  printf(1, "%d page touches in %d ticks: %d per 100 ticks\n",
+         NCHILD * npages * (NPASS+1), t, NCHILD * npages * (NPASS+1) * 100 / t);
+  printf(1, "%d page-outs, %d page-ins: %d faults per 100 ticks\n",
+         after.npageout - before.npageout, after.npagein - before.npagein,
+         (after.npagein - before.npagein) * 100 / t);
+  if(after.nused != before.nused)
+    printf(1, "swaptest: %d swap slots leaked\n", after.nused - before.nused);
+  if(nok != NCHILD || after.nused != before.nused){
+    printf(1, "swaptest failed\n");
+    exit();
+  }
+  printf(1, "swaptest OK\n");
+  exit();
+}
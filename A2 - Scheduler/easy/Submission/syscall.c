@@ -4,6 +4,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
 #include "x86.h"
 #include "syscall.h"
 
@@ -17,32 +20,17 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  return copyin(myproc()->pgdir, ip, addr, sizeof(*ip));
 }
 
-// Fetch the nul-terminated string at addr from the current process.
-// Doesn't actually copy the string - just sets *pp to point at it.
-// Returns length of string, not including nul.
+// Copy the nul-terminated string at addr from the current
+// process into buf, which holds max bytes.  A copy, since
+// threads sharing the memory could change the string after
+// it was checked.  Returns length of string, not including nul.
 int
-fetchstr(uint addr, char **pp)
+fetchstr(uint addr, char *buf, int max)
 {
-  char *s, *ep;
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz)
-    return -1;
-  *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
-  }
-  return -1;
+  return copyinstr(myproc()->pgdir, buf, addr, max);
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -53,33 +41,53 @@ argint(int n, int *ip)
 }
 
 // Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+// to a block of memory of size bytes, which the kernel will
+// write if write is set.  Check that the block lies within
+// the process address space, and fault it in now so that a
+// bad pointer fails before any work is done.  Another thread
+// can still unmap the block at any time, so the kernel must
+// reach it only through copyin() and copyout(), never by
+// dereferencing the pointer, and never while holding an
+// inode or buffer lock that a fault might need.
+static int
+argbuf(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || (uint)i >= KERNBASE)
+    return -1;
+  if(vmprefault(curproc, i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
-// Fetch the nth word-sized system call argument as a string pointer.
-// Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// A buffer that the system call only reads.
+int
+argptr(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 0);
+}
+
+// A buffer that the system call fills in.
+int
+argoutptr(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 1);
+}
+
+// Fetch the nth word-sized system call argument as a string,
+// copied into buf, which holds max bytes.
 int
-argstr(int n, char **pp)
+argstr(int n, char *buf, int max)
 {
   int addr;
   if(argint(n, &addr) < 0)
     return -1;
-  return fetchstr(addr, pp);
+  return fetchstr(addr, buf, max);
 }
 
 extern int sys_chdir(void);
@@ -107,6 +115,22 @@ extern int sys_sched_policy(void);
 extern int sys_exec_time(void);
 extern int sys_deadline(void);
 extern int sys_rate(void);
+extern int sys_tickets(void);
+extern int sys_lockstat(void);
+extern int sys_buddyinfo(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_msync(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_swapinfo(void);
+extern int sys_meminfo(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_spawn(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -134,6 +158,22 @@ static int (*syscalls[])(void) = {
 [SYS_exec_time]   sys_exec_time,
 [SYS_deadline]    sys_deadline,
 [SYS_rate]        sys_rate,
+[SYS_tickets]     sys_tickets,
+[SYS_lockstat]    sys_lockstat,
+[SYS_buddyinfo]   sys_buddyinfo,
+[SYS_mmap]        sys_mmap,
+[SYS_munmap]      sys_munmap,
+[SYS_msync]       sys_msync,
+[SYS_shmget]      sys_shmget,
+[SYS_shmat]       sys_shmat,
+[SYS_shmdt]       sys_shmdt,
+[SYS_swapinfo]    sys_swapinfo,
+[SYS_meminfo]     sys_meminfo,
+[SYS_clone]       sys_clone,
+[SYS_join]        sys_join,
+[SYS_futex_wait]  sys_futex_wait,
+[SYS_futex_wake]  sys_futex_wake,
+[SYS_spawn]       sys_spawn,
 };
 
 void
@@ -24,3 +24,19 @@
 #define SYS_exec_time  23
 #define SYS_deadline   24
 #define SYS_rate       25
+#define SYS_tickets    26
+#define SYS_lockstat   27
+#define SYS_buddyinfo  28
+#define SYS_mmap       29
+#define SYS_munmap     30
+#define SYS_msync      31
+#define SYS_shmget     32
+#define SYS_shmat      33
+#define SYS_shmdt      34
+#define SYS_swapinfo   35
+#define SYS_meminfo    36
+#define SYS_clone      37
+#define SYS_join       38
+#define SYS_futex_wait 39
+#define SYS_futex_wake 40
+#define SYS_spawn      41
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -73,7 +74,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argoutptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -107,21 +108,25 @@ int
 sys_fstat(void)
 {
   struct file *f;
-  struct stat *st;
+  struct stat st;
+  uint addr;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(1, (int*)&addr) < 0)
+    return -1;
+  if(filestat(f, &st) < 0 ||
+     copyout(myproc()->pgdir, addr, &st, sizeof(st)) < 0)
     return -1;
-  return filestat(f, st);
+  return 0;
 }
 
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
 {
-  char name[DIRSIZ], *new, *old;
+  char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
 
-  if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
+  if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
     return -1;
 
   begin_op();
@@ -186,10 +191,10 @@ sys_unlink(void)
 {
   struct inode *ip, *dp;
   struct dirent de;
-  char name[DIRSIZ], *path;
+  char name[DIRSIZ], path[MAXPATH];
   uint off;
 
-  if(argstr(0, &path) < 0)
+  if(argstr(0, path, MAXPATH) < 0)
     return -1;
 
   begin_op();
@@ -285,12 +290,12 @@ create(char *path, short type, short major, short minor)
 int
 sys_open(void)
 {
-  char *path;
+  char path[MAXPATH];
   int fd, omode;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
     return -1;
 
   begin_op();
@@ -335,11 +340,13 @@ sys_open(void)
 int
 sys_mkdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
 
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if((ip = create(path, T_DIR, 0, 0)) == 0){
     end_op();
     return -1;
   }
@@ -352,14 +359,15 @@ int
 sys_mknod(void)
 {
   struct inode *ip;
-  char *path;
+  char path[MAXPATH];
   int major, minor;
 
-  begin_op();
-  if((argstr(0, &path)) < 0 ||
+  if(argstr(0, path, MAXPATH) < 0 ||
      argint(1, &major) < 0 ||
-     argint(2, &minor) < 0 ||
-     (ip = create(path, T_DEV, major, minor)) == 0){
+     argint(2, &minor) < 0)
+    return -1;
+  begin_op();
+  if((ip = create(path, T_DEV, major, minor)) == 0){
     end_op();
     return -1;
   }
@@ -371,12 +379,14 @@ sys_mknod(void)
 int
 sys_chdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
   struct proc *curproc = myproc();
   
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
+  if((ip = namei(path)) == 0){
     end_op();
     return -1;
   }
@@ -393,52 +403,174 @@ sys_chdir(void)
   return 0;
 }
 
-int
-sys_exec(void)
+// Copy the argument vector at user address uargv into argv,
+// a string per kernel page: exec() frees the memory they are
+// in.  On error, or once done with them, call freeargv().
+static int
+fetchargv(uint uargv, char **argv)
 {
-  char *path, *argv[MAXARG];
   int i;
-  uint uargv, uarg;
+  uint uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv))
+    if(i >= MAXARG)
       return -1;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
       return -1;
     if(uarg == 0){
       argv[i] = 0;
-      break;
+      return 0;
     }
-    if(fetchstr(uarg, &argv[i]) < 0)
+    if((argv[i] = kalloc()) == 0 || fetchstr(uarg, argv[i], PGSIZE) < 0)
       return -1;
   }
-  return exec(path, argv);
+}
+
+static void
+freeargv(char **argv)
+{
+  int i;
+
+  for(i = 0; i < MAXARG && argv[i]; i++)
+    kfree(argv[i]);
+}
+
+int
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  int r;
+  uint uargv;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, (int*)&uargv) < 0){
+    return -1;
+  }
+  r = -1;
+  if(fetchargv(uargv, argv) == 0)
+    r = exec(path, argv);
+  freeargv(argv);
+  return r;
+}
+
+// spawn(path, argv, fds, nfd): start path in a new child.
+// If fds is 0 the child gets all the caller's descriptors;
+// otherwise its descriptor i is the caller's fds[i] for i
+// below nfd, or none if fds[i] is -1.  Returns the pid.
+int
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct file *ofile[NOFILE];
+  int fds[NOFILE], nfd, i, r;
+  uint uargv, ufds;
+  struct proc *curproc = myproc();
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, (int*)&uargv) < 0 ||
+     argint(2, (int*)&ufds) < 0 || argint(3, &nfd) < 0)
+    return -1;
+  if(ufds){
+    if(nfd < 0 || nfd > NOFILE ||
+       copyin(curproc->pgdir, fds, ufds, nfd*sizeof(int)) < 0)
+      return -1;
+    memset(ofile, 0, sizeof(ofile));
+    for(i = 0; i < nfd; i++){
+      if(fds[i] == -1)
+        continue;
+      if(fds[i] < 0 || fds[i] >= NOFILE || curproc->ofile[fds[i]] == 0)
+        return -1;
+      ofile[i] = curproc->ofile[fds[i]];
+    }
+  }
+  r = -1;
+  if(fetchargv(uargv, argv) == 0)
+    r = spawn(path, argv, ufds ? ofile : 0);
+  freeargv(argv);
+  return r;
 }
 
 int
 sys_pipe(void)
 {
-  int *fd;
+  int fd[2];
   struct file *rf, *wf;
-  int fd0, fd1;
+  uint addr;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argint(0, (int*)&addr) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
-  fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+  fd[0] = fd[1] = -1;
+  if((fd[0] = fdalloc(rf)) < 0 || (fd[1] = fdalloc(wf)) < 0 ||
+     copyout(myproc()->pgdir, addr, fd, sizeof(fd)) < 0){
+    if(fd[0] >= 0)
+      myproc()->ofile[fd[0]] = 0;
+    if(fd[1] >= 0)
+      myproc()->ofile[fd[1]] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
-  fd[0] = fd0;
-  fd[1] = fd1;
   return 0;
 }
+
+// Map a file, or zero-filled memory with MAP_ANON, into the
+// address space.  The kernel picks the address; addr must be 0.
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, off;
+  struct file *f;
+  struct inode *ip;
+  uint filesz;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(addr != 0 || len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if((prot & PROT_READ) == 0)
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(flags & MAP_ANON)
+    return mmap(myproc(), len, prot, flags, 0, 0, 0);
+
+  if(argfd(4, 0, &f) < 0 || f->type != FD_INODE || !f->readable)
+    return -1;
+  if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+  ip = f->ip;
+  ilock(ip);
+  if(ip->type != T_FILE){
+    iunlock(ip);
+    return -1;
+  }
+  filesz = ip->size > off ? ip->size - off : 0;
+  iunlock(ip);
+  if(filesz > len)
+    filesz = len;
+  return mmap(myproc(), len, prot, flags, ip, off, filesz);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return munmap(myproc(), addr, len);
+}
+
+// Write the shared file mappings in a range back to their files.
+int
+sys_msync(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return msync(myproc(), addr, len);
+}
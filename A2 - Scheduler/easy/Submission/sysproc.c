@@ -6,6 +6,10 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "lockstat.h"
+#include "buddyinfo.h"
+#include "swapinfo.h"
+#include "meminfo.h"
 
 int
 sys_fork(void)
@@ -26,6 +30,59 @@ sys_wait(void)
   return wait();
 }
 
+// Start a thread running fcn(arg1, arg2) on the one-page
+// stack at the fourth argument.
+int
+sys_clone(void)
+{
+  int fcn, arg1, arg2, stack;
+
+  if(argint(0, &fcn) < 0 || argint(1, &arg1) < 0 ||
+     argint(2, &arg2) < 0 || argint(3, &stack) < 0)
+    return -1;
+  return clone(fcn, arg1, arg2, stack);
+}
+
+// Wait for a thread to exit, and store the stack it was
+// given at the first argument.
+int
+sys_join(void)
+{
+  uint addr, stack;
+  int pid;
+
+  if(argint(0, (int*)&addr) < 0)
+    return -1;
+  if((pid = join(&stack)) >= 0 &&
+     copyout(myproc()->pgdir, addr, &stack, sizeof(stack)) < 0)
+    return -1;
+  return pid;
+}
+
+// Sleep if the int at the first argument still holds the
+// second, until a futex_wake() on it.
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+// Wake up to n processes sleeping on the int at the first
+// argument; returns how many.
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
 int
 sys_kill(void)
 {
@@ -45,15 +102,11 @@ sys_getpid(void)
 int
 sys_sbrk(void)
 {
-  int addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
-    return -1;
-  return addr;
+  return growproc(n);
 }
 
 int
@@ -137,3 +190,124 @@ sys_rate(void)
     	
 	return rate(pid, rte);
 }
+
+int 
+sys_tickets(void)
+{
+	int pid, n;
+  	if(argint(0, &pid) < 0)
+    		return -1;
+    	if(argint(1, &n) < 0)
+    		return -1;
+    	
+	return tickets(pid, n);
+}
+
+// Copy lock contention counters into the user's array
+// of n entries; returns the number of entries filled.
+int
+sys_lockstat(void)
+{
+  struct lockstat *ls;
+  uint addr;
+  int n;
+
+  if(argint(0, (int*)&addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if((ls = (struct lockstat*)kalloc()) == 0)
+    return -1;
+  n = lockstat(ls, n);
+  if(copyout(myproc()->pgdir, addr, ls, n*sizeof(*ls)) < 0)
+    n = -1;
+  kfree((char*)ls);
+  return n;
+}
+
+// Report free physical memory by block size.
+int
+sys_buddyinfo(void)
+{
+  struct buddyinfo bi;
+  uint addr;
+
+  if(argint(0, (int*)&addr) < 0)
+    return -1;
+  kbuddyinfo(&bi);
+  return copyout(myproc()->pgdir, addr, &bi, sizeof(bi));
+}
+
+// Find or create the shared memory segment called name,
+// of at least size bytes; returns its id.
+int
+sys_shmget(void)
+{
+  char name[MAXPATH];
+  int size;
+
+  if(argstr(0, name, MAXPATH) < 0 || argint(1, &size) < 0 || size <= 0)
+    return -1;
+  return shmget(myproc(), name, size);
+}
+
+// Attach a shared memory segment; returns its address.
+int
+sys_shmat(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmat(myproc(), id);
+}
+
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdt(myproc(), addr);
+}
+
+// Report swap space use and paging counts.
+int
+sys_swapinfo(void)
+{
+  struct swapinfo si;
+  uint addr;
+
+  if(argint(0, (int*)&addr) < 0)
+    return -1;
+  kswapinfo(&si);
+  return copyout(myproc()->pgdir, addr, &si, sizeof(si));
+}
+
+// Report free memory and allocation counts in the first
+// argument, and the memory of up to n processes in the
+// second.  Returns the number of processes reported.
+int
+sys_meminfo(void)
+{
+  struct meminfo mi;
+  struct procmem *pm;
+  uint maddr, paddr;
+  int n;
+
+  if(argint(0, (int*)&maddr) < 0 || argint(1, (int*)&paddr) < 0 ||
+     argint(2, &n) < 0 || n < 0)
+    return -1;
+  if(n > NPROC)
+    n = NPROC;
+  if((pm = (struct procmem*)kalloc()) == 0)
+    return -1;
+  kmeminfo(&mi);
+  n = procmem(pm, n);
+  if(copyout(myproc()->pgdir, maddr, &mi, sizeof(mi)) < 0 ||
+     copyout(myproc()->pgdir, paddr, pm, n*sizeof(*pm)) < 0)
+    n = -1;
+  kfree((char*)pm);
+  return n;
+}
@@ -0,0 +1,204 @@
+// Test clone() and join() through thread_create() and
+// thread_join(): threads share memory, the heap and its growth,
+// take turns with a lock, fault in the same fresh pages at once,
+// and leave no memory behind when joined.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 4
+#define NITER   2000
+#define PGSIZE  4096
+#define NPAGE   64
+
+lock_t lock;
+volatile int counter;
+volatile char *shared;     // fresh heap pages the threads all touch
+volatile int go;           // released together for the page race
+
+void
+joinall(int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(thread_join() < 0)
+      fail("thread_join failed");
+  if(thread_join() != -1)
+    fail("thread_join found an extra thread");
+}
+
+// Add to the shared counter under the lock.
+void
+adder(void *a, void *b)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    lock_acquire(&lock);
+    counter = counter + (int)a + (int)b;
+    lock_release(&lock);
+  }
+  exit();
+}
+
+void
+countertest(void)
+{
+  int i;
+
+  printf(1, "shared counter test\n");
+  lock_init(&lock);
+  counter = 0;
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(adder, (void*)1, (void*)2) < 0)
+      fail("thread_create failed");
+  joinall(NTHREAD);
+  if(counter != NTHREAD * NITER * 3)
+    fail("counter is wrong");
+}
+
+// Allocate and free from the one heap at the same time.
+void
+mallocer(void *a, void *b)
+{
+  char *p[16];
+  int i, j;
+
+  for(i = 0; i < 100; i++){
+    for(j = 0; j < 16; j++){
+      if((p[j] = malloc(16 + j*100)) == 0)
+        fail("malloc failed");
+      memset(p[j], (int)a, 16 + j*100);
+    }
+    for(j = 0; j < 16; j++){
+      if(p[j][0] != (char)(int)a || p[j][15 + j*100] != (char)(int)a)
+        fail("malloc block overwritten");
+      free(p[j]);
+    }
+  }
+  exit();
+}
+
+void
+malloctest(void)
+{
+  int i;
+
+  printf(1, "concurrent malloc test\n");
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(mallocer, (void*)(i + 1), 0) < 0)
+      fail("thread_create failed");
+  joinall(NTHREAD);
+}
+
+// Wait for the go signal, then write a word in each shared
+// page that no thread has touched yet.
+void
+toucher(void *a, void *b)
+{
+  int i;
+
+  while(!go)
+    ;
+  for(i = 0; i < NPAGE; i++)
+    shared[i*PGSIZE + (int)a*4] = (int)a + 1;
+  exit();
+}
+
+void
+faulttest(void)
+{
+  int i, t;
+
+  printf(1, "concurrent fault test\n");
+  go = 0;
+  if((shared = sbrk(NPAGE*PGSIZE)) == (char*)-1)
+    fail("sbrk failed");
+  for(t = 0; t < NTHREAD; t++)
+    if(thread_create(toucher, (void*)t, 0) < 0)
+      fail("thread_create failed");
+  go = 1;
+  joinall(NTHREAD);
+  for(i = 0; i < NPAGE; i++)
+    for(t = 0; t < NTHREAD; t++)
+      if(shared[i*PGSIZE + t*4] != t + 1)
+        fail("a thread's write to a fresh page was lost");
+  sbrk(-NPAGE*PGSIZE);
+}
+
+// Grow the heap in a thread; the creator must see it.
+void
+grower(void *a, void *b)
+{
+  char *p;
+
+  if((p = sbrk(PGSIZE)) == (char*)-1)
+    fail("sbrk in thread failed");
+  p[0] = 'g';
+  *(char**)a = p;
+  exit();
+}
+
+void
+sbrktest(void)
+{
+  char *p;
+
+  printf(1, "shared sbrk test\n");
+  p = 0;
+  if(thread_create(grower, &p, 0) < 0)
+    fail("thread_create failed");
+  joinall(1);
+  if(p == 0 || p[0] != 'g')
+    fail("creator does not see the thread's sbrk");
+  if(sbrk(0) != p + PGSIZE)
+    fail("heap size not shared");
+  sbrk(-PGSIZE);
+}
+
+// fork() from a program with threads still gives the child
+// its own memory, and wait() ignores threads.
+void
+forktest(void)
+{
+  int pid;
+
+  printf(1, "fork test\n");
+  counter = 0;
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    counter = 7;
+    exit();
+  }
+  if(thread_create(adder, (void*)0, (void*)0) < 0)
+    fail("thread_create failed");
+  if(wait() != pid)
+    fail("wait did not return the child");
+  if(counter != 0)
+    fail("child's write reached the parent");
+  joinall(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfree;
+
+  // The first run grows the heap; measure leaks after it.
+  countertest();
+  malloctest();
+  nfree = freepages();
+  countertest();
+  malloctest();
+  faulttest();
+  sbrktest();
+  forktest();
+  if(freepages() != nfree)
+    printf(1, "threadtest: %d pages not freed\n", nfree - freepages());
+  printf(1, "threadtest OK\n");
+  exit();
+}
@@ -10,6 +10,7 @@
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
+static char dfstack[NCPU][PGSIZE];  // Stacks for double faults
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
@@ -23,13 +24,46 @@ tvinit(void)
   for(i = 0; i < 256; i++)
     SETGATE(idt[i], 0, SEG_KCODE<<3, vectors[i], 0);
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
+  // A kernel stack overflow faults while pushing the trap frame
+  // onto the guard page, which the cpu turns into a double
+  // fault.  That cannot be delivered on the same stack either,
+  // so it goes through a task gate to a task with its own.
+  SETGATE(idt[T_DBLFLT], 0, SEG_DFTSS<<3, 0, 0);
+  idt[T_DBLFLT].type = STS_TG;
 
   initlock(&tickslock, "time");
 }
 
+// Runs as the double-fault task, on this cpu's dfstack.
+static void
+dblfault(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *p = c->proc;
+
+  cprintf("cpu%d: double fault at eip 0x%x esp 0x%x, pid %d %s\n",
+          cpuid(), c->ts.eip, c->ts.esp, p ? p->pid : 0, p ? p->name : "");
+  if(kstackguard((uint)c->ts.esp - 4))
+    panic("kernel stack overflow");
+  panic("double fault");
+}
+
 void
 idtinit(void)
 {
+  struct cpu *c = mycpu();
+  struct taskstate *ts = &c->dfts;
+
+  memset(ts, 0, sizeof(*ts));
+  ts->cr3 = (void*)V2P(kpgdir);
+  ts->eip = (uint*)dblfault;
+  ts->eflags = 0x2;
+  ts->esp = (uint*)(dfstack[c - cpus] + PGSIZE);
+  ts->cs = SEG_KCODE << 3;
+  ts->ss = ts->ds = ts->es = SEG_KDATA << 3;
+  ts->iomb = (ushort) 0xFFFF;
+  c->gdt[SEG_DFTSS] = SEG16(STS_T32A, ts, sizeof(*ts)-1, 0);
+  c->gdt[SEG_DFTSS].s = 0;
   lidt(idt, sizeof(idt));
 }
 
@@ -41,7 +75,9 @@ trap(struct trapframe *tf)
     if(myproc()->killed)
       exit();
     myproc()->tf = tf;
+    myproc()->insyscall = 1;
     syscall();
+    myproc()->insyscall = 0;
     if(myproc()->killed)
       exit();
     return;
@@ -78,11 +114,22 @@ trap(struct trapframe *tf)
             cpuid(), tf->cs, tf->eip);
     lapiceoi();
     break;
+  case T_PGFLT:
+    // A copy-on-write or lazily allocated page, touched from
+    // user space or by the kernel using a user buffer?
+    if(myproc()){
+      myproc()->nfault++;
+      if(vmfault(myproc(), rcr2(), tf->err & FEC_WR) == 0)
+        break;
+    }
+    // Otherwise, a real fault.
 
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
+      if(tf->trapno == T_PGFLT && kstackguard(rcr2()))
+        panic("kernel stack overflow");
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
               tf->trapno, cpuid(), tf->eip, rcr2());
       panic("trap");
@@ -113,7 +160,7 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->state == RUNNING && (tf->trapno == T_IRQ0+IRQ_TIMER))
      {
      	//cprintf("process pid %d exec_time %d policy %d\n",myproc()->pid, myproc()->elapsed_time, myproc()->policy);  
-	if((myproc()->policy != -1) && (myproc()->elapsed_time >= myproc()->exec_time))
+	if((myproc()->policy == 0 || myproc()->policy == 1) && (myproc()->elapsed_time >= myproc()->exec_time))
 	{
 	//cprintf("2process pid %d exec_time %d policy %d\n",myproc()->pid, myproc()->elapsed_time, myproc()->policy); 
 	cprintf("The arrival time and pid value of the completed process is %d %d\n",myproc()->arrival_time, myproc()->pid);
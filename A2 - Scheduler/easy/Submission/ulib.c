@@ -104,3 +104,126 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Ticket lock: threads get the lock in the order they asked.
+void
+lock_init(lock_t *lk)
+{
+  lk->ticket = 0;
+  lk->turn = 0;
+}
+
+void
+lock_acquire(lock_t *lk)
+{
+  uint t;
+
+  t = __sync_fetch_and_add(&lk->ticket, 1);
+  while(*(volatile uint*)&lk->turn != t)
+    ;
+  __sync_synchronize();
+}
+
+void
+lock_release(lock_t *lk)
+{
+  __sync_fetch_and_add(&lk->turn, 1);
+}
+
+// Mutex that sleeps in the kernel when contended, after Drepper,
+// "Futexes Are Tricky".  val is 0 when unlocked, 1 when locked,
+// and 2 when locked with possible waiters, so an uncontended
+// lock and unlock make no system call.
+void
+mutex_init(mutex_t *m)
+{
+  m->val = 0;
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->val, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->val, 2);
+  while(c != 0){
+    futex_wait(&m->val, 2);
+    c = __sync_lock_test_and_set(&m->val, 2);
+  }
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+  if(__sync_fetch_and_sub(&m->val, 1) != 1){
+    m->val = 0;
+    futex_wake(&m->val, 1);
+  }
+}
+
+// Condition variable: waiters sleep on a sequence number that
+// each signal bumps.  Wakeups may be spurious, so callers
+// recheck their condition in a loop.
+void
+cond_init(cond_t *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+  int seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(cond_t *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);
+}
+
+// Barrier for n threads: each barrier_wait() returns once all
+// n have called it, after which the barrier can be reused.
+void
+barrier_init(barrier_t *b, int n)
+{
+  mutex_init(&b->lock);
+  cond_init(&b->cv);
+  b->n = n;
+  b->count = 0;
+  b->gen = 0;
+}
+
+void
+barrier_wait(barrier_t *b)
+{
+  int gen;
+
+  mutex_lock(&b->lock);
+  gen = b->gen;
+  if(++b->count == b->n){
+    b->count = 0;
+    b->gen++;
+    cond_broadcast(&b->cv);
+  } else {
+    while(gen == b->gen)
+      cond_wait(&b->cv, &b->lock);
+  }
+  mutex_unlock(&b->lock);
+}
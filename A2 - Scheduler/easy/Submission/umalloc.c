@@ -3,39 +3,60 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator with size classes.
+//
+// A request of up to MAXSMALL bytes, header included, is
+// rounded up to a power of two and served from that class's
+// free list, which is refilled by carving up a CHUNK of fresh
+// memory; freeing pushes the block back.  Both are O(1), and a
+// small block never moves to another class.  Larger requests
+// take whole pages from a free list of page runs kept in
+// address order, as in Kernighan and Ritchie, The C
+// Programming Language, 2nd ed., Section 8.7: first fit,
+// coalescing on free, growing the heap with sbrk() when
+// nothing fits.  Each block's header records its size, so
+// free() knows which path to take.
+
+#define PGSIZE    4096
+#define MINSHIFT  4                    // smallest class: 16 bytes
+#define MAXSHIFT  11                   // largest class: 2048 bytes
+#define NCLASS    (MAXSHIFT - MINSHIFT + 1)
+#define MAXSMALL  (1 << MAXSHIFT)
+#define CHUNK     (4*PGSIZE)           // memory carved per refill
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;                 // Next free block, while free
+    uint size;                         // Bytes in the block, header included
   } s;
   Align x;
 };
 
 typedef union header Header;
 
-static Header base;
+static Header *freelist[NCLASS];       // Free small blocks by class
+static Header base;                    // Free page runs, circular from base
 static Header *freep;
+static lock_t lock;   // Threads share the free lists; zero is unlocked
 
-void
-free(void *ap)
+// Put the page run bp on the run list, merging it with its
+// neighbours.
+static void
+freerun(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
-  if(bp + bp->s.size == p->s.ptr){
+  if((char*)bp + bp->s.size == (char*)p->s.ptr){
     bp->s.size += p->s.ptr->s.size;
     bp->s.ptr = p->s.ptr->s.ptr;
   } else
     bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
+  if((char*)p + p->s.size == (char*)bp){
     p->s.size += bp->s.size;
     p->s.ptr = bp->s.ptr;
   } else
@@ -43,48 +64,122 @@ free(void *ap)
   freep = p;
 }
 
+// Grow the heap by at least n bytes, a multiple of PGSIZE,
+// starting on a page boundary.
 static Header*
-morecore(uint nu)
+morecore(uint n)
 {
   char *p;
+  uint pad;
   Header *hp;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
+  if(n < CHUNK)
+    n = CHUNK;
+  p = sbrk(0);
+  pad = (PGSIZE - (uint)p % PGSIZE) % PGSIZE;
+  p = sbrk(pad + n);
   if(p == (char*)-1)
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
+  hp = (Header*)(p + pad);
+  hp->s.size = n;
+  freerun(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// Take a run of n bytes, a multiple of PGSIZE.
+static Header*
+allocrun(uint n)
 {
   Header *p, *prevp;
-  uint nunits;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
   }
   for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
+    if(p->s.size >= n){
+      if(p->s.size == n)
         prevp->s.ptr = p->s.ptr;
       else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
+        p->s.size -= n;
+        p = (Header*)((char*)p + p->s.size);
+        p->s.size = n;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      return p;
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(n)) == 0)
         return 0;
   }
 }
+
+// Return a free block of class c, refilling the class if
+// it is empty.
+static Header*
+allocsmall(int c)
+{
+  Header *p, *run;
+  uint size;
+  char *a;
+
+  if((p = freelist[c]) == 0){
+    if((run = allocrun(CHUNK)) == 0)
+      return 0;
+    size = 1 << (c + MINSHIFT);
+    for(a = (char*)run; a + size <= (char*)run + CHUNK; a += size){
+      p = (Header*)a;
+      p->s.size = size;
+      p->s.ptr = freelist[c];
+      freelist[c] = p;
+    }
+    p = freelist[c];
+  }
+  freelist[c] = p->s.ptr;
+  return p;
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+  int c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  lock_acquire(&lock);
+  if(bp->s.size <= MAXSMALL){
+    for(c = 0; (1 << (c + MINSHIFT)) < bp->s.size; c++)
+      ;
+    bp->s.ptr = freelist[c];
+    freelist[c] = bp;
+  } else {
+    freerun(bp);
+  }
+  lock_release(&lock);
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *p;
+  uint n;
+  int c;
+
+  if(nbytes > 0x7fffffff - PGSIZE)
+    return 0;
+  n = nbytes + sizeof(Header);
+  lock_acquire(&lock);
+  if(n <= MAXSMALL){
+    for(c = 0; (1 << (c + MINSHIFT)) < n; c++)
+      ;
+    p = allocsmall(c);
+  } else {
+    p = allocrun((n + PGSIZE - 1) & ~(PGSIZE - 1));
+  }
+  lock_release(&lock);
+  if(p == 0)
+    return 0;
+  return (void*)(p + 1);
+}
@@ -1,5 +1,33 @@
 struct stat;
 struct rtcdate;
+struct lockstat;
+struct buddyinfo;
+struct swapinfo;
+struct meminfo;
+struct procmem;
+
+// A lock for threads sharing memory; see ulib.c.
+typedef struct {
+  uint ticket;                 // Next ticket to hand out
+  uint turn;                   // Ticket now holding the lock
+} lock_t;
+
+// Locks that sleep with futex_wait(); see ulib.c.
+typedef struct {
+  volatile int val;            // 0 unlocked, 1 locked, 2 locked with waiters
+} mutex_t;
+
+typedef struct {
+  volatile int seq;            // Bumped by each signal
+} cond_t;
+
+typedef struct {
+  mutex_t lock;
+  cond_t cv;
+  int n;                       // Threads to wait for
+  int count;                   // Threads waiting now
+  int gen;                     // Bumped each time the barrier opens
+} barrier_t;
 
 // system calls
 int fork(void);
@@ -27,6 +55,22 @@ int sched_policy(int pid, int policy);
 int exec_time(int pid, int exec_tim);
 int deadline(int pid, int deadlin);
 int rate(int pid, int rte);
+int tickets(int pid, int n);
+int lockstat(struct lockstat*, int);
+int buddyinfo(struct buddyinfo*);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int msync(void*, int);
+int shmget(char*, int);
+void* shmat(int);
+int shmdt(void*);
+int swapinfo(struct swapinfo*);
+int meminfo(struct meminfo*, struct procmem*, int);
+int clone(void(*)(void*, void*), void*, void*, void*);
+int join(void**);
+int futex_wait(volatile int*, int);
+int futex_wake(volatile int*, int);
+int spawn(char*, char**, int*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -41,3 +85,21 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int thread_create(void(*)(void*, void*), void*, void*);
+int thread_join(void);
+void lock_init(lock_t*);
+void lock_acquire(lock_t*);
+void lock_release(lock_t*);
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+void mutex_unlock(mutex_t*);
+void cond_init(cond_t*);
+void cond_wait(cond_t*, mutex_t*);
+void cond_signal(cond_t*);
+void cond_broadcast(cond_t*);
+void barrier_init(barrier_t*, int);
+void barrier_wait(barrier_t*);
+
+// utest.c
+int freepages(void);
+void fail(char*);
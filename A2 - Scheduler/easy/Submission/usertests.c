@@ -1748,8 +1748,28 @@ rand()
 int
 main(int argc, char *argv[])
 {
+  int i;
+
   printf(1, "usertests starting\n");
 
+  // Run just the named concurrent file system tests,
+  // e.g. to measure lock contention with lockstat.
+  if(argc > 1){
+    for(i = 1; i < argc; i++){
+      if(strcmp(argv[i], "concreate") == 0)
+        concreate();
+      else if(strcmp(argv[i], "fourfiles") == 0)
+        fourfiles();
+      else if(strcmp(argv[i], "createdelete") == 0)
+        createdelete();
+      else if(strcmp(argv[i], "sharedfd") == 0)
+        sharedfd();
+      else
+        printf(1, "usertests: unknown test %s\n", argv[i]);
+    }
+    exit();
+  }
+
   if(open("usertests.ran", 0) >= 0){
     printf(1, "already ran user tests -- rebuild fs.img\n");
     exit();
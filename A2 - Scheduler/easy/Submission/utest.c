@@ -0,0 +1,30 @@
+// Helpers shared by the test and benchmark programs.
+
+#include "types.h"
+#include "user.h"
+#include "buddyinfo.h"
+
+// Free physical pages, including those in the cpu caches.
+int
+freepages(void)
+{
+  struct buddyinfo bi;
+  int k, n;
+
+  if(buddyinfo(&bi) < 0){
+    printf(1, "buddyinfo failed\n");
+    exit();
+  }
+  n = bi.ncached;
+  for(k = 0; k <= KMAXORDER; k++)
+    n += bi.nfree[k] << k;
+  return n;
+}
+
+// Report a failed check and exit.
+void
+fail(char *msg)
+{
+  printf(1, "FAILED: %s\n", msg);
+  exit();
+}
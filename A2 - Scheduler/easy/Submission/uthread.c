@@ -0,0 +1,39 @@
+// User threads: clone() and join() with a malloc()ed stack.
+
+#include "types.h"
+#include "user.h"
+
+#define PGSIZE 4096
+
+// Start a thread running fcn(arg1, arg2) on a fresh one-page
+// stack.  clone() wants the stack page-aligned, so allocate
+// two pages and keep the pointer malloc() returned in the
+// bottom word of the aligned page, for thread_join().
+// Returns the thread's pid, or -1.
+int
+thread_create(void (*fcn)(void*, void*), void *arg1, void *arg2)
+{
+  void *mem, *stack;
+  int pid;
+
+  if((mem = malloc(2*PGSIZE)) == 0)
+    return -1;
+  stack = (void*)(((uint)mem + PGSIZE - 1) & ~(PGSIZE - 1));
+  *(void**)stack = mem;
+  if((pid = clone(fcn, arg1, arg2, stack)) < 0)
+    free(mem);
+  return pid;
+}
+
+// Wait for a thread to exit and free its stack.
+// Returns its pid, or -1 if there are no threads.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(*(void**)stack);
+  return pid;
+}
@@ -5,7 +5,12 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
 #include "elf.h"
+#include "mman.h"
+#include "meminfo.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -42,10 +47,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -57,7 +61,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -79,6 +83,37 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Map the kernel range [va, va+size) to pa in pgdir.  Where
+// va and pa are both 4MB-aligned and at least 4MB remain, a
+// single PTE_PS directory entry maps the whole superpage, and
+// no page table is needed.  Kernel mappings are global, so
+// they stay in the TLB across the lcr3() of a process switch.
+static int
+kmappages(pde_t *pgdir, char *va, uint size, uint pa, int perm)
+{
+  pte_t *pte;
+  uint n;
+
+  size = PGROUNDUP(size);
+  for(; size > 0; size -= n, va += n, pa += n){
+    if((uint)va % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 &&
+       size >= SUPERPGSIZE){
+      n = SUPERPGSIZE;
+      if(pgdir[PDX(va)] & PTE_P)
+        panic("kmappages: remap");
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS | PTE_G;
+    } else {
+      n = PGSIZE;
+      if((pte = walkpgdir(pgdir, va, 1)) == 0)
+        return -1;
+      if(*pte & PTE_P)
+        panic("kmappages: remap");
+      *pte = pa | perm | PTE_P | PTE_G;
+    }
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -94,11 +129,22 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //                for the kernel's instructions and r/o data
 //   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
 //                                  rw data + free physical memory
+//   KSTACKBASE..: process kernel stacks, see kstackalloc()
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
+//
+// Only the first 4MB of the kernel half, where the read-only
+// text begins, needs a page table; the rest is 4MB superpages.
+// kpgdir's entries above KERNBASE never change after boot, so
+// every other page directory just copies them, sharing the one
+// kernel page table and the page tables of the stack region.
+
+// Bytes of the stack region per process: a guard page and
+// the stack.
+#define KSTACKSLOT ((KSTACKPAGES+1)*PGSIZE)
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -120,19 +166,90 @@ setupkvm(void)
 {
   pde_t *pgdir;
   struct kmap *k;
+  uint a;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
+  if(kpgdir){
+    memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+            (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
+    return pgdir;
+  }
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
+    if(kmappages(pgdir, k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm) < 0)
+      panic("setupkvm");
+  if(KSTACKBASE < (uint)P2V(PHYSTOP) ||
+     KSTACKBASE + NPROC*KSTACKSLOT > DEVSPACE)
+    panic("setupkvm: kstack region");
+  for(a = KSTACKBASE; a < KSTACKBASE + NPROC*KSTACKSLOT; a += SUPERPGSIZE)
+    if(walkpgdir(pgdir, (char*)a, 1) == 0)
+      panic("setupkvm");
+  return pgdir;
+}
+
+// Each process's kernel stack has a slot in the region at
+// KSTACKBASE, indexed by its proc[] entry: an unmapped guard
+// page, then KSTACKPAGES pages from kalloc().  A stack that
+// overflows faults on the guard instead of running over the
+// memory below it.  The region's page tables are made at boot
+// and shared by every page directory, so a stack mapped here
+// is seen by all of them.
+//
+// Unlike the rest of the kernel's mappings, stack PTEs are not
+// global, so lcr3() drops them.  A slot's pages change when it
+// is reused; the only cpu that can touch the new stack before
+// its next lcr3() is the one that set it up, and
+// kstackalloc() flushes the old translation there.
+
+// Map a kernel stack in slot and return its lowest address,
+// or 0 if out of memory.
+char*
+kstackalloc(int slot)
+{
+  char *kstack, *mem;
+  pte_t *pte;
+  int i;
+
+  kstack = (char*)KSTACKBASE + slot*KSTACKSLOT + PGSIZE;
+  for(i = 0; i < KSTACKPAGES; i++){
+    if((mem = kalloc()) == 0){
+      kstackfree(kstack);
       return 0;
     }
-  return pgdir;
+    pte = walkpgdir(kpgdir, kstack + i*PGSIZE, 0);
+    if(*pte & PTE_P)
+      panic("kstackalloc: remap");
+    *pte = V2P(mem) | PTE_W | PTE_P;
+    invlpg(kstack + i*PGSIZE);
+  }
+  return kstack;
+}
+
+// Free the pages of the kernel stack at kstack.
+void
+kstackfree(char *kstack)
+{
+  pte_t *pte;
+  int i;
+
+  for(i = 0; i < KSTACKPAGES; i++){
+    pte = walkpgdir(kpgdir, kstack + i*PGSIZE, 0);
+    if(*pte & PTE_P){
+      kfree(P2V(PTE_ADDR(*pte)));
+      *pte = 0;
+    }
+  }
+}
+
+// Is va in the guard page of a kernel stack?
+int
+kstackguard(uint va)
+{
+  return va >= KSTACKBASE && va < KSTACKBASE + NPROC*KSTACKSLOT &&
+         (va - KSTACKBASE) % KSTACKSLOT < PGSIZE;
 }
 
 // Allocate one page table for the machine for the kernel address
@@ -186,8 +303,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
@@ -231,13 +347,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = ualloc(1);
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -273,6 +388,9 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(PTE_ADDR(*pte) >> PTXSHIFT);
+      *pte = 0;
     }
   }
   return newsz;
@@ -288,7 +406,8 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  // The kernel's page tables belong to kpgdir.
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -297,6 +416,32 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
+// Make an address space around page table pgdir, used by
+// one process.  Returns 0 if out of memory.
+struct vmspace*
+vmspacealloc(pde_t *pgdir)
+{
+  struct vmspace *vm;
+
+  if((vm = kmalloc(sizeof(*vm))) == 0)
+    return 0;
+  memset(vm, 0, sizeof(*vm));
+  initsleeplock(&vm->lock, "vmspace");
+  vm->ref = 1;
+  vm->nlive = 1;
+  vm->pgdir = pgdir;
+  return vm;
+}
+
+// Free an address space nobody uses, and its memory.
+// Its regions must already be closed.
+void
+vmspacefree(struct vmspace *vm)
+{
+  freevm(vm->pgdir);
+  kmfree(vm);
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -310,37 +455,597 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
+// Map the page at va in pgdir into d too: outright if share
+// is set, else copy-on-write.
+static int
+copypage(pde_t *d, pde_t *pgdir, uint va, int share)
+{
+  pte_t *pte, *dpte;
+  uint pa;
+
+  // Pages not touched yet stay lazy in the child too.
+  if((pte = walkpgdir(pgdir, (void *) va, 0)) == 0)
+    return 0;
+  if(*pte & PTE_SWAP){
+    // The child reads its own copy back from the same slot.
+    if((dpte = walkpgdir(d, (void *) va, 1)) == 0)
+      return -1;
+    *dpte = *pte;
+    swapdup(PTE_ADDR(*pte) >> PTXSHIFT);
+    return 0;
+  }
+  if(!(*pte & PTE_P))
+    return 0;
+  // Both sides map a copy-on-write page read-only; the first
+  // to write takes a private copy in vmfault().
+  if(!share && (*pte & PTE_W))
+    *pte = (*pte & ~PTE_W) | PTE_COW;
+  pa = PTE_ADDR(*pte);
+  if(mappages(d, (void*)va, PGSIZE, pa, PTE_FLAGS(*pte)) < 0)
+    return -1;
+  kincref(P2V(pa));
+  return 0;
+}
+
+// Given a parent process's page table and regions, create a
+// copy of it for a child.  The two share the user pages
+// copy-on-write, except for MAP_SHARED mappings and shared
+// memory segments, which they share outright.
 pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+copyuvm(pde_t *pgdir, uint sz, struct vma *vma)
 {
   pde_t *d;
-  pte_t *pte;
-  uint pa, i, flags;
-  char *mem;
+  struct vma *v;
+  uint i;
 
   if((d = setupkvm()) == 0)
     return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+  for(i = 0; i < sz; i += PGSIZE)
+    if(copypage(d, pgdir, i, 0) < 0)
       goto bad;
+  for(v = vma; v < &vma[NVMA]; v++)
+    if(v->type == VMA_MMAP || v->type == VMA_SHM)
+      for(i = v->start; i < v->end; i += PGSIZE)
+        if(copypage(d, pgdir, i,
+                    v->type == VMA_SHM || (v->flags & MAP_SHARED)) < 0)
+          goto bad;
+  // pgdir is the current process's, whose TLB entries
+  // may still allow writes.
+  lcr3(V2P(pgdir));
+  return d;
+
+bad:
+  lcr3(V2P(pgdir));
+  freevm(d);
+  return 0;
+}
+
+// Give the copy-on-write page at va, mapped by *pte, to the
+// writer: a private copy of the page, or the page itself
+// once no one else shares it.  vm is the address space that
+// *pte belongs to, or 0 for a page table no thread runs on
+// yet.  A copy moves va to another frame, while other threads
+// of vm may still read the old one, which the fork child now
+// owns, through their TLBs; keep them off the cpus meanwhile.
+static int
+cowfault(struct vmspace *vm, pte_t *pte, uint va)
+{
+  uint pa;
+  char *mem;
+
+  pa = PTE_ADDR(*pte);
+  if(krefcount(P2V(pa)) == 1){
+    *pte = (*pte | PTE_W) & ~PTE_COW;
+  } else {
+    if((mem = ualloc(0)) == 0)
+      return -1;
     memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
+    if(vm)
+      vmstop(vm);
+    *pte = V2P(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+    if(vm)
+      vmresume(vm);
+    kfree(P2V(pa));
+  }
+  invlpg((void*)PGROUNDDOWN(va));
+  return 0;
+}
+
+// Read the paged-out page named by *pte back from swap.
+static int
+swapfault(pte_t *pte)
+{
+  uint slot;
+  char *mem;
+
+  slot = PTE_ADDR(*pte) >> PTXSHIFT;
+  if((mem = ualloc(0)) == 0)
+    return -1;
+  swapread(slot, mem);
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_P;
+  swapfree(slot);
+  return 0;
+}
+
+static struct vma *findvma(struct proc*, uint);
+
+// Page out up to max of p's pages to swap.  p must not be
+// running on another cpu, and nothing may be using its
+// memory.  A clock hand sweeps p's user pages: a page used
+// since the hand last passed (PTE_A set) gets another chance,
+// and the others are paged out.  Pages shared with another
+// page table or the page cache stay, and so do the pages of
+// shm segments and MAP_SHARED mappings even when unshared for
+// now: a swapped copy could not be shared again, and a file
+// page would lose its dirty bit.  The caller must flush the
+// TLB if p's page table is loaded.  Returns the number of
+// pages paged out.
+int
+pageout(struct proc *p, int max)
+{
+  pde_t *pde;
+  pte_t *pte;
+  uint va;
+  int n, slot, wraps;
+  char *mem;
+  struct vma *v;
+
+  n = 0;
+  va = p->vm->swaphand;
+  for(wraps = 0; n < max && wraps < 2; ){
+    pde = &p->pgdir[PDX(va)];
+    if((*pde & PTE_P) == 0){
+      va = PGADDR(PDX(va) + 1, 0, 0);
+    } else {
+      pte = &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(va)];
+      if((*pte & (PTE_P|PTE_U)) == (PTE_P|PTE_U) &&
+         krefcount(P2V(PTE_ADDR(*pte))) == 1 &&
+         ((v = findvma(p, va)) == 0 || (v->type != VMA_SHM &&
+          !(v->type == VMA_MMAP && (v->flags & MAP_SHARED))))){
+        if(*pte & PTE_A){
+          *pte &= ~PTE_A;
+        } else {
+          if((slot = swapalloc()) < 0)
+            break;
+          mem = P2V(PTE_ADDR(*pte));
+          swapwrite(slot, mem);
+          *pte = (slot << PTXSHIFT) | PTE_SWAP |
+                 (PTE_FLAGS(*pte) & ~(PTE_P|PTE_A|PTE_D));
+          kfree(mem);
+          n++;
+        }
+      }
+      va += PGSIZE;
+    }
+    if(va >= KERNBASE){
+      va = 0;
+      wraps++;
+    }
+  }
+  p->vm->swaphand = va;
+  return n;
+}
+
+// Count pgdir's user pages in memory and in swap, and its
+// page-table pages, into pm.  The owner may be changing them
+// meanwhile, so the counts are only a snapshot.
+void
+vmcount(pde_t *pgdir, struct procmem *pm)
+{
+  pte_t *pgtab;
+  uint i, j;
+
+  pm->rss = 0;
+  pm->nswap = 0;
+  pm->npgtab = 1;
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if((pgdir[i] & PTE_P) == 0 || PTE_ADDR(pgdir[i]) >= PHYSTOP)
+      continue;
+    pm->npgtab++;
+    pgtab = (pte_t*)P2V(PTE_ADDR(pgdir[i]));
+    for(j = 0; j < NPTENTRIES; j++){
+      if(pgtab[j] & PTE_P)
+        pm->rss++;
+      else if(pgtab[j] & PTE_SWAP)
+        pm->nswap++;
+    }
+  }
+}
+
+// Find p's region containing va, if any.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++)
+    if(v->type && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Is va in one of p's regions whose pages other address
+// spaces map too, a shm segment or a MAP_SHARED mapping?
+int
+vmshared(struct proc *p, uint va)
+{
+  struct vma *v;
+  int r;
+
+  acquiresleep(&p->vm->lock);
+  v = findvma(p, va);
+  r = v && (v->type == VMA_SHM ||
+            (v->type == VMA_MMAP && (v->flags & MAP_SHARED)));
+  releasesleep(&p->vm->lock);
+  return r;
+}
+
+// Handle a page fault by p at user address va: a page that was
+// paged out, a write to a copy-on-write page, or the first
+// touch of a page that exec(), sbrk() or mmap() handed out
+// without allocating.  File pages come from the page cache,
+// shared copy-on-write, or outright for a MAP_SHARED mapping;
+// reading them in, or paging in, may sleep.
+// Returns 0 if the faulting access can be retried, -1 if it
+// was an error.  Caller holds p->vm->lock.
+static int
+fault(struct proc *p, uint va, int write)
+{
+  pte_t *pte;
+  char *mem;
+  struct vma *v;
+  uint n, perm;
+  int shared;
+
+  if(va >= KERNBASE)
+    return -1;
+  v = findvma(p, va);
+  if(va >= p->vm->sz && (v == 0 || v->type != VMA_MMAP))
+    return -1;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_SWAP))
+    return swapfault(pte);
+  if(pte && (*pte & PTE_P)){
+    if((*pte & PTE_U) == 0)
+      return -1;
+    if(!write || (*pte & PTE_W)){
+      // Another thread mapped the page while this one was
+      // waiting for the lock; this cpu may have cached the
+      // old entry.
+      invlpg((void*)PGROUNDDOWN(va));
+      return 0;
+    }
+    if((*pte & PTE_COW) == 0)
+      return -1;
+    return cowfault(p->vm, pte, va);
+  }
+
+  va = PGROUNDDOWN(va);
+  perm = PTE_W|PTE_U;
+  if(v && v->type == VMA_MMAP && (v->prot & PROT_WRITE) == 0)
+    perm = PTE_U;
+  if(v && v->ip && va - v->start < v->filesz){
+    n = v->filesz - (va - v->start);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    shared = v->type == VMA_MMAP && (v->flags & MAP_SHARED);
+    if((mem = pcget(v->ip, v->off + (va - v->start), n, shared)) == 0)
+      return -1;
+    if((perm & PTE_W) && !shared)
+      perm = PTE_U|PTE_COW;
+  } else {
+    if((mem = ualloc(1)) == 0)
+      return -1;
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+int
+vmfault(struct proc *p, uint va, int write)
+{
+  int r;
+
+  acquiresleep(&p->vm->lock);
+  r = fault(p, va, write);
+  releasesleep(&p->vm->lock);
+  return r;
+}
+
+// Make sure the n bytes of p's memory at va are mapped, and
+// writable if write is set, so that the kernel can use them
+// without faulting.  Returns -1 if they are not p's to use.
+int
+vmprefault(struct proc *p, uint va, uint n, int write)
+{
+  uint a;
+  pte_t *pte;
+
+  if(va + n < va)
+    return -1;
+  acquiresleep(&p->vm->lock);
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte == 0 || (*pte & PTE_P) == 0){
+      if(fault(p, a, write) < 0)
+        goto bad;
+      pte = walkpgdir(p->pgdir, (char*)a, 0);
+    }
+    if((*pte & PTE_U) == 0)
       goto bad;
+    if(write && (*pte & PTE_W) == 0){
+      if((*pte & PTE_COW) == 0 || cowfault(p->vm, pte, a) < 0)
+        goto bad;
     }
   }
-  return d;
+  releasesleep(&p->vm->lock);
+  return 0;
 
 bad:
-  freevm(d);
+  releasesleep(&p->vm->lock);
+  return -1;
+}
+
+// Copy the region table src to dst, e.g. for fork().
+void
+vmadup(struct vma *dst, struct vma *src)
+{
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    dst[i] = src[i];
+    if(src[i].ip)
+      dst[i].ip = idup(src[i].ip);
+    if(src[i].type == VMA_SHM)
+      shmdup(src[i].off);
+  }
+}
+
+// Drop the files and segments of vm's regions, and the
+// segments it holds from shmget().
+// Must be called inside a transaction, since it calls iput().
+void
+vmaclose(struct vmspace *vm)
+{
+  struct vma *v = vm->vma;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    if(v[i].ip)
+      iput(v[i].ip);
+    if(v[i].type == VMA_SHM)
+      shmput(v[i].off);
+    v[i].ip = 0;
+    v[i].type = 0;
+  }
+  for(i = 0; i < NSHM; i++)
+    if(vm->shmheld & (1 << i))
+      shmput(i);
+  vm->shmheld = 0;
+}
+
+// Lowest address used by an mmap() region or shared memory
+// segment, or KERNBASE; the heap may grow up to here.
+// Caller holds p->vm->lock.
+uint
+mmapbase(struct proc *p)
+{
+  struct vma *v;
+  uint base;
+
+  base = KERNBASE;
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++)
+    if((v->type == VMA_MMAP || v->type == VMA_SHM) && v->start < base)
+      base = v->start;
+  return base;
+}
+
+// Write the pages of region v in [start, end) that were
+// written through pgdir back to v's file, if v is a shared
+// file mapping.  Runs its own transactions.
+static void
+vmawriteback(pde_t *pgdir, struct vma *v, uint start, uint end)
+{
+  // As in filewrite(), to stay within a log transaction.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  uint a, n, i, m;
+  pte_t *pte;
+  char *mem;
+
+  if(v->type != VMA_MMAP || v->ip == 0 || (v->flags & MAP_SHARED) == 0)
+    return;
+  for(a = start; a < end && a - v->start < v->filesz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(pte == 0 || (*pte & (PTE_P|PTE_D)) != (PTE_P|PTE_D))
+      continue;
+    mem = P2V(PTE_ADDR(*pte));
+    n = v->filesz - (a - v->start);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    for(i = 0; i < n; i += m){
+      m = n - i;
+      if(m > max)
+        m = max;
+      begin_op();
+      ilock(v->ip);
+      writei(v->ip, mem + i, v->off + (a - v->start) + i, m);
+      iunlock(v->ip);
+      end_op();
+    }
+    *pte &= ~PTE_D;
+    invlpg((void*)a);
+  }
+}
+
+// Write back every shared file mapping of a region table,
+// e.g. when the process exits.
+void
+vmaflush(pde_t *pgdir, struct vma *vma)
+{
+  struct vma *v;
+
+  for(v = vma; v < &vma[NVMA]; v++)
+    if(v->type == VMA_MMAP)
+      vmawriteback(pgdir, v, v->start, v->end);
+}
+
+// Make region v start at a, higher up, keeping the file
+// offset of each page.
+static void
+vmatrim(struct vma *v, uint a)
+{
+  uint d;
+
+  d = a - v->start;
+  v->off += d;
+  v->filesz = v->filesz > d ? v->filesz - d : 0;
+  v->start = a;
+}
+
+static int unmap(struct proc*, uint, uint);
+
+// Map len bytes at a new address in p, below the previous
+// mappings: zero-filled memory if ip is 0, else file ip from
+// offset off, of which filesz bytes exist.  Pages are filled
+// in by vmfault().  Returns the address, or -1.
+int
+mmap(struct proc *p, uint len, int prot, int flags, struct inode *ip,
+     uint off, uint filesz)
+{
+  struct vma *v;
+  uint start, a;
+
+  len = PGROUNDUP(len);
+  acquiresleep(&p->vm->lock);
+  start = mmapbase(p);
+  if(len == 0 || start < len || start - len < PGROUNDUP(p->vm->sz))
+    goto bad;
+  start -= len;
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++)
+    if(v->type == 0)
+      break;
+  if(v == &p->vm->vma[NVMA])
+    goto bad;
+  v->type = VMA_MMAP;
+  v->start = start;
+  v->end = start + len;
+  v->ip = ip ? idup(ip) : 0;
+  v->off = off;
+  v->filesz = filesz;
+  v->prot = prot;
+  v->flags = flags;
+
+  if(ip == 0 && (flags & MAP_SHARED)){
+    // A child shares only the pages that exist at fork().
+    for(a = start; a < start + len; a += PGSIZE){
+      if(fault(p, a, 0) < 0){
+        unmap(p, start, len);
+        goto bad;
+      }
+    }
+  }
+  releasesleep(&p->vm->lock);
+  return start;
+
+bad:
+  releasesleep(&p->vm->lock);
+  return -1;
+}
+
+// Remove p's mappings of [addr, addr+len), writing shared file
+// pages back first.  Parts of a region may be unmapped.
+// Caller holds p->vm->lock.
+static int
+unmap(struct proc *p, uint addr, uint len)
+{
+  struct vma *v, *nv;
+  uint end, s, e;
+
+  end = PGROUNDUP(addr + len);
+  if(addr % PGSIZE || len == 0 || end <= addr || end > KERNBASE)
+    return -1;
+
+  // Punching a hole splits a region, which needs a free slot.
+  for(nv = p->vm->vma; nv < &p->vm->vma[NVMA]; nv++)
+    if(nv->type == 0)
+      break;
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++)
+    if(v->type == VMA_MMAP && addr > v->start && end < v->end &&
+       nv == &p->vm->vma[NVMA])
+      return -1;
+
+  vmstop(p->vm);
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++){
+    if(v->type != VMA_MMAP || end <= v->start || addr >= v->end)
+      continue;
+    s = addr > v->start ? addr : v->start;
+    e = end < v->end ? end : v->end;
+    vmawriteback(p->pgdir, v, s, e);
+    deallocuvm(p->pgdir, e, s);
+    if(s > v->start && e < v->end){
+      *nv = *v;
+      if(nv->ip)
+        nv->ip = idup(nv->ip);
+      vmatrim(nv, e);
+      v->end = s;
+    } else if(s > v->start){
+      v->end = s;
+    } else if(e < v->end){
+      vmatrim(v, e);
+    } else {
+      if(v->ip){
+        begin_op();
+        iput(v->ip);
+        end_op();
+      }
+      v->ip = 0;
+      v->type = 0;
+    }
+  }
+  lcr3(V2P(p->pgdir));
+  vmresume(p->vm);
+  return 0;
+}
+
+int
+munmap(struct proc *p, uint addr, uint len)
+{
+  int r;
+
+  acquiresleep(&p->vm->lock);
+  r = unmap(p, addr, len);
+  releasesleep(&p->vm->lock);
+  return r;
+}
+
+// Write p's shared file pages in [addr, addr+len) back
+// to their files.  Their dirty bits are cleared, so no cpu may
+// keep a TLB entry that would write them without setting the
+// bit again.
+int
+msync(struct proc *p, uint addr, uint len)
+{
+  struct vma *v;
+  uint end, s, e;
+
+  end = addr + len;
+  if(addr % PGSIZE || end < addr)
+    return -1;
+  acquiresleep(&p->vm->lock);
+  vmstop(p->vm);
+  for(v = p->vm->vma; v < &p->vm->vma[NVMA]; v++){
+    if(v->type != VMA_MMAP || end <= v->start || addr >= v->end)
+      continue;
+    s = addr > v->start ? addr : v->start;
+    e = end < v->end ? end : v->end;
+    vmawriteback(p->pgdir, v, s, e);
+  }
+  lcr3(V2P(p->pgdir));
+  vmresume(p->vm);
+  releasesleep(&p->vm->lock);
   return 0;
 }
 
@@ -352,16 +1057,85 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
+// Kernel address of the user page at va in pgdir, for the
+// kernel to read, or to write if write is set.  Reading or
+// writing through the kernel's mapping bypasses page faults,
+// so a page that is paged out or shared copy-on-write is
+// fixed up first, and, if pgdir is the current process's, so
+// is one that was never touched.  The page is returned with a
+// reference taken, so that another thread's munmap() cannot
+// free it during the copy; drop it with kfree().  Returns 0 if
+// va is not user memory, or not writable when write is set.
+static char*
+uvmpage(pde_t *pgdir, uint va, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  char *ka;
+  int fixed;
+
+  if(va >= KERNBASE)
+    return 0;
+  for(fixed = 0; ; fixed = 1){
+    // With interrupts off this thread stays on the cpu, so
+    // vmstop() holds off any change to the PTE until it has
+    // the reference.
+    pushcli();
+    pte = walkpgdir(pgdir, (char*)va, 0);
+    if(pte && (*pte & (PTE_P|PTE_U)) == (PTE_P|PTE_U) &&
+       (!write || (*pte & PTE_W))){
+      ka = (char*)P2V(PTE_ADDR(*pte));
+      kincref(ka);
+      popcli();
+      return ka;
+    }
+    popcli();
+    if(p && p->pgdir == pgdir){
+      // Another thread may undo the fault-in before we look
+      // again; that is rare, so just try again.
+      if(vmprefault(p, va, 1, write) < 0)
+        return 0;
+    } else {
+      if(fixed)
+        return 0;
+      if(pte && (*pte & PTE_SWAP) && swapfault(pte) < 0)
+        return 0;
+      if(write && pte && (*pte & (PTE_P|PTE_COW)) == (PTE_P|PTE_COW) &&
+         cowfault(0, pte, va) < 0)
+        return 0;
+    }
+  }
+}
+
+// The kernel wrote the user page at va, kernel address ka,
+// through its own mapping, so the hardware did not mark the
+// user PTE; do it, so that msync() writes the data back.  This
+// comes after the write, in case a writeback cleared PTE_D
+// meanwhile.  Nothing to do if the page was unmapped.
+static void
+uvmdirty(pde_t *pgdir, uint va, char *ka)
+{
+  pte_t *pte;
+
+  pushcli();
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_P) && PTE_ADDR(*pte) == V2P(ka))
+    *pte |= PTE_D|PTE_A;
+  popcli();
+}
+
 // Copy len bytes from p to user address va in page table pgdir.
-// Most useful when pgdir is not the current page table.
-// uva2ka ensures this only works for PTE_U pages.
+// Each page is checked once and copied with one memmove(), so
+// whole aligned pages go with rep movsl.
+// Returns 0 on success, -1 if any of the range is not
+// writable user memory.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
@@ -371,13 +1145,40 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
-    pa0 = uva2ka(pgdir, (char*)va0);
-    if(pa0 == 0)
+    if((pa0 = uvmpage(pgdir, va0, 1)) == 0)
       return -1;
     n = PGSIZE - (va - va0);
     if(n > len)
       n = len;
     memmove(pa0 + (va - va0), buf, n);
+    uvmdirty(pgdir, va0, pa0);
+    kfree(pa0);
+    len -= n;
+    buf += n;
+    va = va0 + PGSIZE;
+  }
+  return 0;
+}
+
+// Copy len bytes to dst from user address va in page table
+// pgdir.  Returns 0 on success, -1 if any of the range is not
+// user memory.
+int
+copyin(pde_t *pgdir, void *dst, uint va, uint len)
+{
+  char *buf, *pa0;
+  uint n, va0;
+
+  buf = (char*)dst;
+  while(len > 0){
+    va0 = (uint)PGROUNDDOWN(va);
+    if((pa0 = uvmpage(pgdir, va0, 0)) == 0)
+      return -1;
+    n = PGSIZE - (va - va0);
+    if(n > len)
+      n = len;
+    memmove(buf, pa0 + (va - va0), n);
+    kfree(pa0);
     len -= n;
     buf += n;
     va = va0 + PGSIZE;
@@ -385,6 +1186,37 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Copy a nul-terminated string to dst from user address va
+// in page table pgdir, copying at most max bytes including
+// the nul.  Returns the length of the string, not including
+// the nul, or -1 if it is not in user memory or too long.
+int
+copyinstr(pde_t *pgdir, char *dst, uint va, uint max)
+{
+  char *pa0, *s;
+  uint n, va0, len;
+
+  len = 0;
+  while(len < max){
+    va0 = (uint)PGROUNDDOWN(va);
+    if((pa0 = uvmpage(pgdir, va0, 0)) == 0)
+      return -1;
+    n = PGSIZE - (va - va0);
+    if(n > max - len)
+      n = max - len;
+    for(s = pa0 + (va - va0); n > 0; n--, s++){
+      if((dst[len] = *s) == 0)
+        break;
+      len++;
+    }
+    kfree(pa0);
+    if(n > 0)
+      return len;
+    va = va0 + PGSIZE;
+  }
+  return -1;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
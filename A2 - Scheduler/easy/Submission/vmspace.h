@@ -0,0 +1,15 @@
+// A user address space: a page table and the regions mapped
+// in it.  fork() and exec() make a new one; clone() shares
+// the caller's, so that threads share memory.
+// Needs sleeplock.h and proc.h.
+struct vmspace {
+  struct sleeplock lock;       // Serializes changes to pgdir, sz and vma
+  int ref;                     // Processes using this, zombies too; under ptable.lock
+  int nlive;                   // Of those, ones that haven't exited; under ptable.lock
+  pde_t *pgdir;                // Page table
+  uint sz;                     // Size of memory below the mmap area (bytes)
+  uint swaphand;               // Where pageout() resumes its clock sweep
+  struct vma vma[NVMA];        // Demand-paged memory regions
+  uint shmheld;                // Bit id: segment id got but not yet attached
+  struct proc *stopper;        // Thread holding the others off the cpus; under ptable.lock
+};